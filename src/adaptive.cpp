@@ -0,0 +1,158 @@
+/**
+ * Adaptive worker count (-j auto): hill-climbs on measured throughput
+ */
+
+#include "adaptive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "io_backend.h"
+#include "worker_pool.h"
+
+namespace {
+
+constexpr auto kInterval = std::chrono::seconds(1);
+
+// A sample covers at least one file per worker, so a few large images don't
+// read as a throughput drop, unless files are so slow that this takes longer
+constexpr auto kMaxWindow = std::chrono::seconds(10);
+
+// Throughput changes smaller than this are treated as noise
+constexpr double kTolerance = 0.05;
+
+// Latency growth that, without a throughput gain, means workers are only
+// contending for cores, memory bandwidth or the disk
+constexpr double kLatencyRise = 1.5;
+
+std::atomic<uint64_t> decoded_pixels{0};
+
+}  // namespace
+
+void count_decoded_pixels(uint64_t pixels) {
+    decoded_pixels.fetch_add(pixels, std::memory_order_relaxed);
+}
+
+ConcurrencyController::ConcurrencyController(WorkerPool& pool, size_t initial, unsigned io_depth)
+    : pool_(pool), io_depth_(io_depth), limit_(std::clamp<size_t>(initial, 1, pool.size())) {
+    pool_.set_concurrency(limit_);
+    if (io_depth_ > 0) {
+        set_io_depth(std::max<unsigned>(1, io_depth_ * limit_ / pool_.size()));
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+ConcurrencyController::~ConcurrencyController() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    thread_.join();
+}
+
+void ConcurrencyController::record_file(double seconds) {
+    files_.fetch_add(1, std::memory_order_relaxed);
+    busy_ns_.fetch_add(static_cast<uint64_t>(seconds * 1e9), std::memory_order_relaxed);
+}
+
+void ConcurrencyController::run() {
+    using clock = std::chrono::steady_clock;
+
+    auto window_start = clock::now();
+    uint64_t pixels_start = decoded_pixels.load(std::memory_order_relaxed);
+    uint64_t files_start = files_.load(std::memory_order_relaxed);
+    uint64_t busy_start = busy_ns_.load(std::memory_order_relaxed);
+    auto restart_window = [&] {
+        window_start = clock::now();
+        pixels_start = decoded_pixels.load(std::memory_order_relaxed);
+        files_start = files_.load(std::memory_order_relaxed);
+        busy_start = busy_ns_.load(std::memory_order_relaxed);
+    };
+
+    Sample last;
+    bool have_last = false;
+    int direction = 1;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stop_cv_.wait_for(lock, kInterval, [this] { return stopping_; })) {
+                return;
+            }
+        }
+
+        // With nothing queued the input is the bottleneck, and the sample
+        // says nothing about how many workers the machine can keep busy
+        if (pool_.queued(Priority::Interactive) + pool_.queued(Priority::Bulk) == 0) {
+            restart_window();
+            have_last = false;
+            continue;
+        }
+
+        const size_t limit = limit_;
+        auto elapsed = clock::now() - window_start;
+        uint64_t files = files_.load(std::memory_order_relaxed) - files_start;
+        if (files < limit && elapsed < kMaxWindow) {
+            continue;
+        }
+        if (files == 0) {
+            restart_window();
+            continue;
+        }
+
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        Sample sample;
+        sample.mpps = (decoded_pixels.load(std::memory_order_relaxed) - pixels_start) / seconds / 1e6;
+        sample.latency = (busy_ns_.load(std::memory_order_relaxed) - busy_start) / 1e9 / files;
+        restart_window();
+
+        size_t next;
+        if (!have_last || last.mpps <= 0) {
+            next = limit + direction;
+        } else {
+            double gain = sample.mpps / last.mpps - 1;
+            if (sample.latency > last.latency * kLatencyRise && gain < kTolerance) {
+                // Multiplicative decrease, then probe upwards again
+                next = limit * 3 / 4;
+                direction = 1;
+            } else if (gain > kTolerance) {
+                next = limit + direction;
+            } else if (gain < -kTolerance) {
+                direction = -direction;
+                next = limit + direction;
+            } else {
+                // Flat: the same throughput with fewer workers is the knee
+                direction = -1;
+                next = limit - 1;
+            }
+        }
+        next = std::clamp<size_t>(next, 1, pool_.size());
+
+        last = sample;
+        have_last = true;
+        if (next != limit) {
+            apply(next, sample);
+        }
+    }
+}
+
+void ConcurrencyController::apply(size_t limit, const Sample& sample) {
+    char line[160];
+    int len = std::snprintf(line, sizeof(line), "🎛️  Workers %zu → %zu at %.1f MP/s, %.2f s/file",
+                            limit_.load(), limit, sample.mpps, sample.latency);
+
+    pool_.set_concurrency(limit);
+    limit_ = limit;
+    changes_++;
+
+    if (io_depth_ > 0 && io_depth() > 0) {
+        unsigned depth = std::max<unsigned>(1, io_depth_ * limit / pool_.size());
+        set_io_depth(depth);
+        len += std::snprintf(line + len, sizeof(line) - len, ", I/O depth %u", io_depth());
+    }
+    std::cout << (std::string(line, std::min<size_t>(len, sizeof(line) - 1)) + "\n") << std::flush;
+}
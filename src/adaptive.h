@@ -0,0 +1,62 @@
+/**
+ * Adaptive worker count (-j auto): hill-climbs on measured throughput
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+class WorkerPool;
+
+// Pixels decoded by every thread, the controller's measure of work done
+void count_decoded_pixels(uint64_t pixels);
+
+// Samples throughput (MP/s) and per-file latency about once a second and
+// moves the pool's concurrency towards the knee of the throughput curve: one
+// worker at a time in the direction that last helped, one fewer when more
+// workers stopped paying, and a cut to three quarters when latency climbs
+// without a throughput gain. The io_uring depth follows the worker count.
+// Decisions are logged to stdout.
+class ConcurrencyController {
+public:
+    // `pool` must have been created with the largest worker count allowed;
+    // the controller starts it at `initial` workers
+    ConcurrencyController(WorkerPool& pool, size_t initial, unsigned io_depth);
+    ~ConcurrencyController();
+
+    ConcurrencyController(const ConcurrencyController&) = delete;
+    ConcurrencyController& operator=(const ConcurrencyController&) = delete;
+
+    // Wall time a worker spent on one finished file
+    void record_file(double seconds);
+
+    size_t limit() const { return limit_; }
+    size_t changes() const { return changes_; }
+
+private:
+    struct Sample {
+        double mpps = 0;     // megapixels per second
+        double latency = 0;  // seconds per file
+    };
+
+    void run();
+    void apply(size_t limit, const Sample& sample);
+
+    WorkerPool& pool_;
+    const unsigned io_depth_;
+    std::atomic<size_t> limit_;
+    std::atomic<size_t> changes_{0};
+
+    std::atomic<uint64_t> files_{0};
+    std::atomic<uint64_t> busy_ns_{0};
+
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,227 @@
+/**
+ * Animated WebP encoding of multi-image HEIF containers
+ */
+
+#include "animate.h"
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <webp/mux.h>
+
+#include "cancel.h"
+#include "decode.h"
+#include "encode.h"
+#include "trace.h"
+
+namespace {
+
+// Frames decoded ahead of the encoder. One thread decodes, so a few frames
+// absorb the variation between frames while keeping memory bounded.
+constexpr size_t kFrameWindow = 4;
+
+DecodedFrame decode_item(heif_context* ctx, heif_item_id id, const Options& opts,
+                         const TraceLabel& label) {
+    TraceFile trace_file(label);
+    DecodedFrame frame;
+    heif_image_handle* handle;
+    heif_error err = heif_context_get_image_handle(ctx, id, &handle);
+
+    if (err.code != heif_error_Ok) {
+        std::cerr << "❌ Failed to get image handle: " << err.message << std::endl;
+        return frame;
+    }
+
+    if (!decode_frame(handle, opts, frame)) {
+        frame.pixels = nullptr;
+    }
+    heif_image_handle_release(handle);
+    return frame;
+}
+
+// Decodes one file's frames in order on a helper thread while the worker
+// encodes them. Each worker keeps one helper for its whole life, so at most
+// one decoder runs per busy worker and the helper registers its metrics and
+// trace state once. Only the helper touches the context until finish().
+class FrameDecoder {
+public:
+    FrameDecoder() : thread_(&FrameDecoder::run, this) {}
+
+    ~FrameDecoder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void start(heif_context* ctx, std::vector<heif_item_id> ids, const Options& opts,
+               const TraceLabel& label) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ctx_ = ctx;
+            ids_ = std::move(ids);
+            opts_ = &opts;
+            label_ = label;
+            next_id_ = 0;
+            abandon_ = false;
+            active_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    // Waits for the next frame in container order; call once per id
+    DecodedFrame next() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !ready_.empty(); });
+        DecodedFrame frame = std::move(ready_.front());
+        ready_.pop_front();
+        lock.unlock();
+        cv_.notify_all();
+        return frame;
+    }
+
+    // Stops after the frame being decoded, if any, and drops the frames
+    // decoded ahead. The context is free for the caller again on return.
+    void finish() {
+        std::deque<DecodedFrame> dropped;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            abandon_ = true;
+            cv_.notify_all();
+            cv_.wait(lock, [this] { return !active_; });
+            dropped.swap(ready_);
+            ctx_ = nullptr;
+        }
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] {
+                return stopping_ || (active_ && (abandon_ || next_id_ == ids_.size() ||
+                                                 ready_.size() < kFrameWindow));
+            });
+            if (stopping_) {
+                return;
+            }
+            if (abandon_ || next_id_ == ids_.size()) {
+                active_ = false;
+                cv_.notify_all();
+                continue;
+            }
+
+            heif_item_id id = ids_[next_id_++];
+            lock.unlock();
+            DecodedFrame frame = decode_item(ctx_, id, *opts_, label_);
+            lock.lock();
+            ready_.push_back(std::move(frame));
+            cv_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    heif_context* ctx_ = nullptr;
+    std::vector<heif_item_id> ids_;
+    const Options* opts_ = nullptr;
+    TraceLabel label_{};
+    size_t next_id_ = 0;
+    bool active_ = false;   // the helper is working on the current file
+    bool abandon_ = false;  // finish() was called
+    bool stopping_ = false;
+    std::deque<DecodedFrame> ready_;
+    std::thread thread_;  // last, so it starts after the members it uses
+};
+
+}  // namespace
+
+bool encode_animation(heif_context* ctx, const Options& opts, WebPData* out) {
+    int count = heif_context_get_number_of_top_level_images(ctx);
+    std::vector<heif_item_id> ids(count);
+    heif_context_get_list_of_top_level_image_IDs(ctx, ids.data(), count);
+
+    WebPConfig config;
+    if (!init_webp_config(opts, config)) {
+        return false;
+    }
+
+    // Decodes run ahead of the encoder, which has to consume frames in order
+    thread_local FrameDecoder decoder;
+    decoder.start(ctx, std::move(ids), opts, TraceFile::current());
+
+    WebPAnimEncoder* enc = nullptr;
+    int timestamp = 0;
+    bool ok = true;
+
+    for (int i = 0; i < count && ok; i++) {
+        DecodedFrame frame = decoder.next();
+
+        if (!frame.pixels || cancelled()) {
+            ok = false;
+            break;
+        }
+
+        if (!enc) {
+            WebPAnimEncoderOptions anim_opts;
+            if (!WebPAnimEncoderOptionsInit(&anim_opts)) {
+                ok = false;
+                break;
+            }
+            anim_opts.anim_params.loop_count = 0;
+            enc = WebPAnimEncoderNew(frame.width, frame.height, &anim_opts);
+            if (!enc) {
+                std::cerr << "❌ Failed to create animation encoder" << std::endl;
+                ok = false;
+                break;
+            }
+        }
+
+        if (opts.verbose) {
+            std::cout << "   Frame " << (i + 1) << "/" << count << ": " 
+                      << frame.width << "x" << frame.height << std::endl;
+        }
+
+        // WebPAnimEncoderAdd works on ARGB and would convert a YUV picture
+        // back, losing precision, so frames are imported as ARGB
+        WebPPicture pic;
+        if (!WebPPictureInit(&pic) || !import_frame(frame, true, pic)) {
+            std::cerr << "❌ Failed to import frame " << (i + 1) << std::endl;
+            WebPPictureFree(&pic);
+            ok = false;
+            break;
+        }
+
+        // Frames are neither scaled nor padded: the canvas has the first frame's
+        // size, and WebPAnimEncoderAdd fails on any frame of another size,
+        // smaller or larger, which fails the whole animation
+        TraceSpan span(TraceStage::Encode);
+        if (!WebPAnimEncoderAdd(enc, &pic, timestamp, &config)) {
+            std::cerr << "❌ Failed to add frame " << (i + 1) << ": " 
+                      << WebPAnimEncoderGetError(enc) << std::endl;
+            ok = false;
+        }
+        WebPPictureFree(&pic);
+        timestamp += opts.frame_delay;
+    }
+
+    decoder.finish();
+    if (ok) {
+        TraceSpan span(TraceStage::Encode);
+        ok = enc && WebPAnimEncoderAdd(enc, nullptr, timestamp, nullptr) &&
+             WebPAnimEncoderAssemble(enc, out);
+        if (!ok && enc) {
+            std::cerr << "❌ Failed to assemble animation: " 
+                      << WebPAnimEncoderGetError(enc) << std::endl;
+        }
+    }
+
+    WebPAnimEncoderDelete(enc);
+    return ok;
+}
@@ -0,0 +1,15 @@
+/**
+ * Animated WebP encoding of multi-image HEIF containers
+ */
+
+#pragma once
+
+#include <libheif/heif.h>
+#include <webp/mux_types.h>
+
+#include "options.h"
+
+// Encodes every top-level image of `ctx`, in container order, as one frame of
+// an animated WebP. Frames are decoded on a helper thread of the calling
+// worker, a bounded number ahead of the encoder. On success `out` owns a buffer released with WebPDataClear.
+bool encode_animation(heif_context* ctx, const Options& opts, WebPData* out);
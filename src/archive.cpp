@@ -0,0 +1,500 @@
+/**
+ * Streaming tar/ZIP input and tar output for batch conversion
+ */
+
+#include "archive.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <new>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "io_backend.h"
+
+namespace {
+
+constexpr size_t kBlock = 512;
+constexpr size_t kReadBuffer = 256 * 1024;
+
+// Sizes in member headers are untrusted and checked before anything is
+// allocated: members against a cap well above any photo, pax records and
+// long names against a much smaller one
+constexpr uint64_t kMaxMemberSize = uint64_t(1) << 30;
+constexpr uint64_t kMaxHeaderSize = uint64_t(1) << 20;
+
+// Forward-only buffered reader, so archives can come from a pipe
+class StreamReader {
+public:
+    explicit StreamReader(int fd) : fd_(fd), buffer_(kReadBuffer) {
+        // From a regular file the bytes left are known; a pipe only has the caps
+        struct stat st;
+        off_t start = ::lseek(fd, 0, SEEK_CUR);
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && start >= 0 && start <= st.st_size) {
+            size_ = static_cast<uint64_t>(st.st_size - start);
+        }
+    }
+
+    // Bytes left in the input, or the largest uint64_t when unknown
+    uint64_t remaining() const { return size_ - std::min(size_, consumed_); }
+
+    // Refills when empty; returns the number of buffered bytes (0 at EOF)
+    size_t available() {
+        if (pos_ == end_) fill();
+        return end_ - pos_;
+    }
+
+    const uint8_t* data() const { return buffer_.data() + pos_; }
+    void consume(size_t n) {
+        pos_ += n;
+        consumed_ += n;
+    }
+
+    bool read(void* dst, size_t n) {
+        auto* out = static_cast<uint8_t*>(dst);
+        while (n > 0) {
+            size_t chunk = std::min(n, available());
+            if (chunk == 0) return false;
+            std::memcpy(out, data(), chunk);
+            consume(chunk);
+            out += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    bool skip(size_t n) {
+        while (n > 0) {
+            size_t chunk = std::min(n, available());
+            if (chunk == 0) return false;
+            consume(chunk);
+            n -= chunk;
+        }
+        return true;
+    }
+
+private:
+    void fill() {
+        pos_ = end_ = 0;
+        for (;;) {
+            ssize_t n = ::read(fd_, buffer_.data(), buffer_.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) end_ = static_cast<size_t>(n);
+            return;
+        }
+    }
+
+    int fd_;
+    std::vector<uint8_t> buffer_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+    uint64_t consumed_ = 0;
+    uint64_t size_ = std::numeric_limits<uint64_t>::max();
+};
+
+// Rejects a size from a member header that the rest of the input can't hold
+// (`stored`, the bytes that follow the header) or that is over `cap`
+bool check_size(const StreamReader& in, uint64_t size, uint64_t stored, uint64_t cap,
+                const std::string& name) {
+    if (stored > in.remaining()) {
+        std::cerr << "❌ Archive member runs past the end of the input: " << name << std::endl;
+        return false;
+    }
+    if (size > cap) {
+        std::cerr << "❌ Archive member too large (" << size << " bytes): " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Normalizes the name, so spellings of one path compare equal, and rejects
+// absolute paths and ".." so members can't escape the output directory
+bool sanitize_member_name(std::string& name) {
+    while (!name.empty() && name[0] == '/') name.erase(0, 1);
+    if (name.empty() || name.back() == '/') return false;
+
+    fs::path normal = fs::path(name).lexically_normal();
+    for (const auto& part : normal) {
+        if (part == "..") return false;
+    }
+    name = normal.generic_string();
+    return !name.empty() && name != "." && name.back() != '/';
+}
+
+void emit_member(std::string name, std::shared_ptr<std::vector<uint8_t>> data,
+                 const std::function<void(ArchiveMember)>& emit) {
+    if (!sanitize_member_name(name)) {
+        std::cerr << "⚠️  Skipping archive member with unsafe path: " << name << std::endl;
+        return;
+    }
+    emit({std::move(name), std::move(data)});
+}
+
+// ---- tar ----
+
+uint64_t parse_tar_number(const char* field, size_t len) {
+    // GNU base-256 for values that don't fit in octal
+    if (static_cast<uint8_t>(field[0]) & 0x80) {
+        uint64_t value = static_cast<uint8_t>(field[0]) & 0x7f;
+        for (size_t i = 1; i < len; i++) value = (value << 8) | static_cast<uint8_t>(field[i]);
+        return value;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < len && field[i]; i++) {
+        if (field[i] >= '0' && field[i] <= '7') value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+std::string tar_string(const char* field, size_t len) {
+    return std::string(field, strnlen(field, len));
+}
+
+// Extracts "path" from pax extended header records ("<len> key=value\n")
+std::string pax_path(const std::vector<uint8_t>& records) {
+    std::string path;
+    size_t pos = 0;
+    while (pos < records.size()) {
+        size_t space = pos;
+        while (space < records.size() && records[space] != ' ') space++;
+        size_t len = std::strtoul(std::string(records.begin() + pos, records.begin() + space).c_str(),
+                                  nullptr, 10);
+        if (len == 0 || pos + len > records.size()) break;
+
+        std::string record(records.begin() + space + 1, records.begin() + pos + len - 1);
+        if (record.compare(0, 5, "path=") == 0) path = record.substr(5);
+        pos += len;
+    }
+    return path;
+}
+
+bool read_tar(StreamReader& in, const std::function<void(ArchiveMember)>& emit) {
+    char header[kBlock];
+    std::string long_name;
+
+    for (;;) {
+        if (!in.read(header, kBlock)) return false;
+        if (std::all_of(header, header + kBlock, [](char c) { return c == 0; })) return true;
+
+        uint64_t size = parse_tar_number(header + 124, 12);
+        char type = header[156];
+        size_t padded = static_cast<size_t>((size + kBlock - 1) / kBlock * kBlock);
+
+        if (type == 'x' || type == 'L') {
+            if (!check_size(in, size, size, kMaxHeaderSize, tar_string(header, 100))) return false;
+            std::vector<uint8_t> data(static_cast<size_t>(size));
+            if (!in.read(data.data(), data.size()) || !in.skip(padded - data.size())) return false;
+            long_name = type == 'x' ? pax_path(data) : tar_string(reinterpret_cast<char*>(data.data()), data.size());
+            continue;
+        }
+
+        if (type != '0' && type != '\0' && type != '7') {
+            // Directories, links, global pax headers, devices
+            if (!in.skip(padded)) return false;
+            long_name.clear();
+            continue;
+        }
+
+        std::string name = long_name;
+        long_name.clear();
+        if (name.empty()) {
+            name = tar_string(header, 100);
+            std::string prefix = tar_string(header + 345, 155);
+            if (std::memcmp(header + 257, "ustar", 5) == 0 && !prefix.empty()) {
+                name = prefix + "/" + name;
+            }
+        }
+
+        if (!check_size(in, size, size, kMaxMemberSize, name)) return false;
+        auto data = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(size));
+        if (!in.read(data->data(), data->size()) || !in.skip(padded - data->size())) return false;
+        emit_member(std::move(name), std::move(data), emit);
+    }
+}
+
+// ---- zip ----
+
+constexpr uint32_t kZipLocalHeader = 0x04034b50;
+constexpr uint32_t kZipCentralHeader = 0x02014b50;
+constexpr uint32_t kZipEndOfCentral = 0x06054b50;
+constexpr uint32_t kZipDataDescriptor = 0x08074b50;
+constexpr uint16_t kZipFlagEncrypted = 1 << 0;
+constexpr uint16_t kZipFlagDataDescriptor = 1 << 3;
+constexpr uint16_t kZipStored = 0;
+constexpr uint16_t kZipDeflated = 8;
+
+uint16_t le16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+uint32_t le32(const uint8_t* p) { return uint32_t(le16(p)) | (uint32_t(le16(p + 2)) << 16); }
+uint64_t le64(const uint8_t* p) { return uint64_t(le32(p)) | (uint64_t(le32(p + 4)) << 32); }
+
+// Inflates a raw deflate stream; works without knowing the compressed size.
+// Fails once the output would pass kMaxMemberSize.
+bool inflate_member(StreamReader& in, std::vector<uint8_t>& out, size_t size_hint) {
+    z_stream zs = {};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+
+    out.resize(std::max<size_t>(size_hint, 64 * 1024));
+    size_t produced = 0;
+    int ret = Z_OK;
+
+    while (ret != Z_STREAM_END) {
+        size_t avail = in.available();
+        if (avail == 0) break;
+        if (produced == out.size()) {
+            if (out.size() >= kMaxMemberSize) break;
+            out.resize(std::min<size_t>(out.size() * 2, kMaxMemberSize));
+        }
+
+        uInt space = static_cast<uInt>(std::min<size_t>(out.size() - produced, 1u << 30));
+        zs.next_in = const_cast<Bytef*>(in.data());
+        zs.avail_in = static_cast<uInt>(avail);  // bounded by the read buffer
+        zs.next_out = out.data() + produced;
+        zs.avail_out = space;
+
+        ret = inflate(&zs, Z_NO_FLUSH);
+        in.consume(avail - zs.avail_in);
+        produced += space - zs.avail_out;
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) break;
+    }
+
+    inflateEnd(&zs);
+    out.resize(produced);
+    return ret == Z_STREAM_END;
+}
+
+bool read_zip(StreamReader& in, const std::function<void(ArchiveMember)>& emit) {
+    for (;;) {
+        uint8_t sig[4];
+        if (!in.read(sig, 4)) return true;  // archives may be cut after the last member
+        uint32_t signature = le32(sig);
+        if (signature == kZipCentralHeader || signature == kZipEndOfCentral) return true;
+        if (signature != kZipLocalHeader) return false;
+
+        uint8_t h[26];
+        if (!in.read(h, sizeof(h))) return false;
+        uint16_t flags = le16(h + 2);
+        uint16_t method = le16(h + 4);
+        uint64_t compressed = le32(h + 14);
+        uint64_t uncompressed = le32(h + 18);
+        uint16_t name_len = le16(h + 22);
+        uint16_t extra_len = le16(h + 24);
+
+        std::string name(name_len, '\0');
+        std::vector<uint8_t> extra(extra_len);
+        if (!in.read(&name[0], name_len) || !in.read(extra.data(), extra_len)) return false;
+
+        // Zip64 extra field carries the real sizes
+        bool zip64 = false;
+        for (size_t pos = 0; pos + 4 <= extra.size();) {
+            uint16_t id = le16(&extra[pos]);
+            uint16_t len = le16(&extra[pos + 2]);
+            if (id == 0x0001 && pos + 4 + len <= extra.size()) {
+                zip64 = true;
+                size_t field = pos + 4;
+                if (uncompressed == 0xffffffff && field + 8 <= pos + 4 + len) {
+                    uncompressed = le64(&extra[field]);
+                    field += 8;
+                }
+                if (compressed == 0xffffffff && field + 8 <= pos + 4 + len) {
+                    compressed = le64(&extra[field]);
+                }
+            }
+            pos += 4 + len;
+        }
+
+        bool sizes_known = !(flags & kZipFlagDataDescriptor);
+        if ((flags & kZipFlagEncrypted) || (method != kZipStored && method != kZipDeflated) ||
+            (method == kZipStored && !sizes_known)) {
+            std::cerr << "❌ Unsupported ZIP member (encrypted or unknown method): " << name << std::endl;
+            return false;
+        }
+
+        // Deflated sizes are only known up front without a data descriptor
+        if (sizes_known && !check_size(in, method == kZipStored ? compressed : uncompressed,
+                                       compressed, kMaxMemberSize, name)) {
+            return false;
+        }
+
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        if (method == kZipStored) {
+            data->resize(static_cast<size_t>(compressed));
+            if (!in.read(data->data(), data->size())) return false;
+        } else if (!inflate_member(in, *data, sizes_known ? static_cast<size_t>(uncompressed) : 0)) {
+            std::cerr << "❌ Corrupt or oversized ZIP member: " << name << std::endl;
+            return false;
+        }
+
+        if (!sizes_known) {
+            // Optional signature, CRC, then 4 or 8 byte sizes
+            uint8_t descriptor[24];
+            if (!in.read(descriptor, 4)) return false;
+            size_t rest = (zip64 ? 16 : 8) + (le32(descriptor) == kZipDataDescriptor ? 4 : 0);
+            if (!in.read(descriptor + 4, rest)) return false;
+        }
+
+        if (!name.empty() && name.back() != '/') {
+            emit_member(std::move(name), std::move(data), emit);
+        }
+    }
+}
+
+// ---- tar output ----
+
+void set_octal(char* field, size_t len, uint64_t value) {
+    // len - 1 digits, NUL terminated
+    for (size_t i = len - 1; i-- > 0;) {
+        field[i] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    field[len - 1] = '\0';
+}
+
+void fill_header(char* header, const std::string& name, uint64_t size, char type) {
+    std::memset(header, 0, kBlock);
+    std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+    set_octal(header + 100, 8, 0644);
+    set_octal(header + 108, 8, 0);
+    set_octal(header + 116, 8, 0);
+    set_octal(header + 124, 12, size);
+    set_octal(header + 136, 12, static_cast<uint64_t>(std::time(nullptr)));
+    header[156] = type;
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (size_t i = 0; i < kBlock; i++) checksum += static_cast<uint8_t>(header[i]);
+    set_octal(header + 148, 7, checksum);
+    header[155] = ' ';
+}
+
+std::string pax_record(const std::string& key, const std::string& value) {
+    // The length prefix counts itself, so settle it iteratively
+    std::string body = " " + key + "=" + value + "\n";
+    size_t len = body.size();
+    while (std::to_string(len).size() + body.size() != len) {
+        len = std::to_string(len).size() + body.size();
+    }
+    return std::to_string(len) + body;
+}
+
+}  // namespace
+
+bool parse_archive_format(const std::string& name, ArchiveFormat& out) {
+    if (name == "tar") {
+        out = ArchiveFormat::Tar;
+    } else if (name == "zip") {
+        out = ArchiveFormat::Zip;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+ArchiveFormat archive_format_for(const fs::path& path) {
+    std::string ext = path.extension().string();
+    for (char& c : ext) c = std::tolower(c);
+    if (ext == ".tar") return ArchiveFormat::Tar;
+    if (ext == ".zip") return ArchiveFormat::Zip;
+    return ArchiveFormat::None;
+}
+
+bool read_archive(int fd, ArchiveFormat format, const std::function<void(ArchiveMember)>& emit) {
+    StreamReader in(fd);
+    try {
+        switch (format) {
+            case ArchiveFormat::Tar: return read_tar(in, emit);
+            case ArchiveFormat::Zip: return read_zip(in, emit);
+            case ArchiveFormat::None: break;
+        }
+    } catch (const std::bad_alloc&) {
+        // Sizes are capped, but a member under the cap can still be too much
+        std::cerr << "❌ Out of memory reading archive member" << std::endl;
+    }
+    return false;
+}
+
+TarWriter::TarWriter(int fd, bool ordered, std::function<void()> on_written)
+    : fd_(fd), ordered_(ordered), on_written_(std::move(on_written)) {}
+
+bool TarWriter::write_entry(const std::string& name, const uint8_t* data, size_t size) {
+    char header[kBlock];
+    static const char zeros[kBlock] = {};
+
+    // Names that don't fit the 100 byte field go into a pax extended header
+    if (name.size() > 100) {
+        std::string pax = pax_record("path", name);
+        fill_header(header, "PaxHeader", pax.size(), 'x');
+        ok_ = ok_ && write_stream(fd_, reinterpret_cast<const uint8_t*>(header), kBlock) &&
+              write_stream(fd_, reinterpret_cast<const uint8_t*>(pax.data()), pax.size()) &&
+              write_stream(fd_, reinterpret_cast<const uint8_t*>(zeros), (kBlock - pax.size() % kBlock) % kBlock);
+    }
+
+    fill_header(header, name, size, '0');
+    ok_ = ok_ && write_stream(fd_, reinterpret_cast<const uint8_t*>(header), kBlock) &&
+          write_stream(fd_, data, size) &&
+          write_stream(fd_, reinterpret_cast<const uint8_t*>(zeros), (kBlock - size % kBlock) % kBlock);
+    return ok_;
+}
+
+bool TarWriter::drain_ready() {
+    for (auto it = waiting_.find(next_sequence_); it != waiting_.end();
+         it = waiting_.find(next_sequence_)) {
+        if (it->second.present) {
+            write_entry(it->second.name, it->second.data.data(), it->second.data.size());
+        }
+        waiting_.erase(it);
+        next_sequence_++;
+        on_written_();
+    }
+    return ok_;
+}
+
+bool TarWriter::add(size_t sequence, const std::string& name, const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ordered_) {
+        write_entry(name, data, size);
+        on_written_();
+        return ok_;
+    }
+
+    Entry& entry = waiting_[sequence];
+    entry.present = true;
+    entry.name = name;
+    if (sequence != next_sequence_) {
+        entry.data.assign(data, data + size);
+        return ok_;
+    }
+
+    // In-order entries skip the copy
+    waiting_.erase(sequence);
+    write_entry(name, data, size);
+    next_sequence_++;
+    on_written_();
+    return drain_ready();
+}
+
+void TarWriter::skip(size_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ordered_) {
+        waiting_[sequence].present = false;
+        drain_ready();
+    } else {
+        on_written_();
+    }
+}
+
+bool TarWriter::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain_ready();
+    static const uint8_t zeros[2 * kBlock] = {};
+    ok_ = ok_ && write_stream(fd_, zeros, sizeof(zeros));
+    return ok_;
+}
@@ -0,0 +1,77 @@
+/**
+ * Streaming tar/ZIP input and tar output for batch conversion
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class ArchiveFormat {
+    None,
+    Tar,
+    Zip,
+};
+
+bool parse_archive_format(const std::string& name, ArchiveFormat& out);
+
+// Guesses the format from a .tar or .zip extension
+ArchiveFormat archive_format_for(const fs::path& path);
+
+struct ArchiveMember {
+    std::string name;  // normalized relative path, already checked for ".." and leading "/"
+    std::shared_ptr<std::vector<uint8_t>> data;
+};
+
+// Reads `fd` front to back without seeking (pipes work) and calls `emit` for
+// each regular file member as soon as its data is in memory. Members with
+// unsafe paths are skipped. Returns false on a malformed or unsupported
+// archive, including a member larger than the input left or than 1 GiB.
+bool read_archive(int fd, ArchiveFormat format, const std::function<void(ArchiveMember)>& emit);
+
+// Writes a POSIX tar stream. Entries are written as they complete, or in
+// sequence order with `ordered`, which holds early finishers in memory.
+// `on_written` runs once per sequence number when its entry is written out or
+// skipped, so callers can bound how many entries are held.
+class TarWriter {
+public:
+    TarWriter(int fd, bool ordered, std::function<void()> on_written);
+
+    TarWriter(const TarWriter&) = delete;
+    TarWriter& operator=(const TarWriter&) = delete;
+
+    bool add(size_t sequence, const std::string& name, const uint8_t* data, size_t size);
+
+    // Releases a sequence number that produces no entry, e.g. a failed conversion
+    void skip(size_t sequence);
+
+    // Writes the end-of-archive marker
+    bool finish();
+
+private:
+    struct Entry {
+        bool present = false;
+        std::string name;
+        std::vector<uint8_t> data;
+    };
+
+    bool write_entry(const std::string& name, const uint8_t* data, size_t size);
+    bool drain_ready();
+
+    int fd_;
+    bool ordered_;
+    bool ok_ = true;
+    std::mutex mutex_;
+    std::function<void()> on_written_;
+    size_t next_sequence_ = 0;
+    std::map<size_t, Entry> waiting_;
+};
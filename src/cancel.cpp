@@ -0,0 +1,86 @@
+/**
+ * Cooperative shutdown on SIGINT and SIGTERM
+ */
+
+#include "cancel.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "output_writer.h"
+
+namespace {
+
+std::atomic<StopMode> mode{StopMode::None};
+sigset_t stop_signals;
+int pipe_fds[2] = {-1, -1};
+
+// Signals arrive here through sigwait, not in a handler, so this may lock,
+// allocate and print like any other thread
+void watch_signals() {
+    for (;;) {
+        int sig;
+        if (sigwait(&stop_signals, &sig) != 0) {
+            continue;
+        }
+
+        switch (mode.load()) {
+        case StopMode::None:
+            if (sig == SIGTERM) {
+                std::cerr << "\n⏸️  SIGTERM: draining, files in progress will finish" << std::endl;
+                mode = StopMode::Drain;
+                break;
+            }
+            // fall through
+        case StopMode::Drain:
+            std::cerr << "\n🛑 Cancelling, interrupt again to exit immediately" << std::endl;
+            mode = StopMode::Cancel;
+            break;
+        case StopMode::Cancel:
+            remove_temp_outputs();
+            std::cerr << "\n🛑 Interrupted" << std::endl;
+            _exit(128 + sig);
+        }
+
+        char byte = 0;
+        while (::write(pipe_fds[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+}  // namespace
+
+bool install_stop_handlers() {
+    if (::pipe(pipe_fds) != 0) {
+        return false;
+    }
+    ::fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+    ::fcntl(pipe_fds[1], F_SETFL, O_NONBLOCK);
+
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr) != 0) {
+        return false;
+    }
+
+    // Never joined; it is blocked in sigwait when the process exits
+    std::thread(watch_signals).detach();
+    return true;
+}
+
+StopMode stop_mode() {
+    return mode.load(std::memory_order_relaxed);
+}
+
+int stop_fd() {
+    return pipe_fds[0];
+}
@@ -0,0 +1,26 @@
+/**
+ * Cooperative shutdown on SIGINT and SIGTERM
+ */
+
+#pragma once
+
+enum class StopMode {
+    None,
+    Drain,   // accept no new work, finish files in progress
+    Cancel,  // also abandon files in progress at the next stage boundary
+};
+
+// Blocks SIGINT and SIGTERM in the calling thread, and so in every thread it
+// starts later, and handles them on a watcher thread instead. SIGTERM drains,
+// SIGINT cancels, a second signal during a drain cancels, and one more while
+// cancelling removes the temp outputs still open and exits at once. Call
+// before any other thread is started.
+bool install_stop_handlers();
+
+StopMode stop_mode();
+inline bool stop_requested() { return stop_mode() != StopMode::None; }
+inline bool cancelled() { return stop_mode() == StopMode::Cancel; }
+
+// Becomes readable once a stop is requested, for poll() loops waiting on
+// input; -1 without install_stop_handlers()
+int stop_fd();
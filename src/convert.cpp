@@ -0,0 +1,346 @@
+/**
+ * Conversion of a single HEIF container to WebP output files
+ */
+
+#include "convert.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "animate.h"
+#include "cancel.h"
+#include "decode.h"
+#include "encode.h"
+#include "io_backend.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "output_writer.h"
+#include "trace.h"
+
+std::string format_bytes(size_t bytes) {
+    char buf[64];
+    if (bytes < 1024) {
+        snprintf(buf, sizeof(buf), "%zu B", bytes);
+    } else if (bytes < 1024 * 1024) {
+        snprintf(buf, sizeof(buf), "%.1f KB", bytes / 1024.0);
+    } else {
+        snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
+    }
+    return buf;
+}
+
+// Read buffers larger than this are not kept around between files
+constexpr size_t kMaxRetainedBuffer = 64 * 1024 * 1024;
+
+HeifContextPtr open_heic(const fs::path& input_path) {
+    // Each worker reuses its read buffer once the previous file's context has
+    // released it, so small files don't allocate and fault in a new one
+    thread_local std::shared_ptr<std::vector<uint8_t>> buffer;
+    if (!buffer || buffer.use_count() > 1 || buffer->capacity() > kMaxRetainedBuffer) {
+        buffer = std::make_shared<std::vector<uint8_t>>();
+    }
+    std::shared_ptr<std::vector<uint8_t>> data = buffer;
+    bool read_ok;
+    {
+        TraceSpan span(TraceStage::Read);
+        read_ok = read_file(input_path, *data);
+    }
+    if (!read_ok) {
+        std::cerr << "❌ Failed to read HEIC: " << input_path << std::endl;
+        return nullptr;
+    }
+    return open_heic_buffer(std::move(data));
+}
+
+HeifContextPtr open_heic_buffer(std::shared_ptr<std::vector<uint8_t>> data) {
+    // libheif parses straight from our buffer, which lives as long as the context
+    TraceSpan span(TraceStage::Parse);
+    count_input_bytes(data->size());
+    auto memory = std::make_shared<MemoryCharge>();
+    memory->add(data->size());
+    HeifContextPtr ctx(heif_context_alloc(), [data, memory](heif_context* c) { heif_context_free(c); });
+    heif_error err = heif_context_read_from_memory_without_copy(ctx.get(), data->data(),
+                                                                data->size(), nullptr);
+    
+    if (err.code != heif_error_Ok) {
+        std::cerr << "❌ Failed to read HEIC: " << err.message << std::endl;
+        return nullptr;
+    }
+    return ctx;
+}
+
+static bool write_encoded(const fs::path& output_path, const uint8_t* data, size_t size,
+                          const std::vector<fs::path>& links) {
+    if (cancelled()) {
+        return false;
+    }
+    TraceSpan span(TraceStage::Write);
+    bool ok = write_output_file(output_path, data, size, links);
+    if (ok) {
+        count_output_bytes(size * (1 + links.size()));
+    }
+    return ok;
+}
+
+bool write_webp(const fs::path& output_path, const WebPData& webp,
+                const std::vector<fs::path>& links) {
+    return write_encoded(output_path, webp.bytes, webp.size, links);
+}
+
+static bool webp_only(const Options& opts) {
+    return opts.formats.size() == 1 && opts.formats[0] == OutputFormat::WebP;
+}
+
+static bool attach_metadata(const ImageMetadata& metadata, const Options& opts, WebPData* webp) {
+    if (opts.verbose && !metadata.empty()) {
+        std::cout << "   Metadata:";
+        if (!metadata.exif.empty()) std::cout << " EXIF " << format_bytes(metadata.exif.size());
+        if (!metadata.xmp.empty()) std::cout << " XMP " << format_bytes(metadata.xmp.size());
+        if (!metadata.icc.empty()) std::cout << " ICC " << format_bytes(metadata.icc.size());
+        std::cout << std::endl;
+    }
+
+    if (!mux_metadata(metadata, webp)) {
+        std::cerr << "❌ Failed to add metadata to WebP" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool decode_image(heif_context* ctx, heif_item_id id, const Options& opts,
+                         DecodedFrame& frame, ImageMetadata& metadata) {
+    heif_image_handle* handle;
+    heif_error err = heif_context_get_image_handle(ctx, id, &handle);
+    
+    if (err.code != heif_error_Ok) {
+        std::cerr << "❌ Failed to get image handle: " << err.message << std::endl;
+        return false;
+    }
+
+    bool decoded = decode_frame(handle, opts, frame);
+    if (decoded) {
+        read_metadata(handle, opts.metadata, metadata);
+    }
+    heif_image_handle_release(handle);
+    if (!decoded || cancelled()) {
+        return false;
+    }
+
+    if (opts.verbose) {
+        std::cout << "   Dimensions: " << frame.width << "x" << frame.height 
+                  << (frame.has_alpha ? " (alpha)" : "") << std::endl;
+        if (frame.bit_depth > 8) {
+            std::cout << "   Bit depth: " << frame.bit_depth << " (tone map: " 
+                      << tone_map_name(frame.tone_map) << ")" << std::endl;
+        }
+    }
+    return true;
+}
+
+static bool encode_image(heif_context* ctx, heif_item_id id, const fs::path& output_path,
+                         const Options& opts, WebPData* out) {
+    DecodedFrame frame;
+    ImageMetadata metadata;
+    if (!decode_image(ctx, id, opts, frame, metadata)) {
+        return false;
+    }
+
+    if (opts.verbose) {
+        std::cout << "💾 Encoding WebP: " << output_path << std::endl;
+    }
+
+    if (!encode_webp(frame, opts, out)) {
+        if (!cancelled()) {
+            std::cerr << "❌ Failed to encode WebP" << std::endl;
+        }
+        return false;
+    }
+    return attach_metadata(metadata, opts, out);
+}
+
+// Encodes one decoded frame into every format of `formats` and writes each
+// result next to `output_path`, with the format's extension. Formats are
+// encoded one after another on the calling worker, so -j bounds the encoder
+// threads and the pool's busy time covers them.
+static bool write_formats(const DecodedFrame& frame, const ImageMetadata& metadata,
+                          const std::vector<OutputFormat>& formats, const fs::path& output_path,
+                          const Options& opts, const std::vector<fs::path>& links) {
+    bool ok = true;
+    for (OutputFormat format : formats) {
+        if (cancelled()) {
+            return false;
+        }
+        const Encoder& encoder = encoder_for(format);
+        fs::path path = fs::path(output_path).replace_extension(encoder.extension);
+        std::vector<fs::path> format_links;
+        for (const auto& link : links) {
+            format_links.push_back(fs::path(link).replace_extension(encoder.extension));
+        }
+        if (opts.verbose) {
+            std::cout << (std::string("💾 Encoding ") + encoder.name + ": " + path.string() + "\n");
+        }
+
+        std::vector<uint8_t> data;
+        ok = encoder.encode(frame, metadata, opts, data) &&
+             write_encoded(path, data.data(), data.size(), format_links) && ok;
+    }
+    return ok;
+}
+
+// --formats other than a lone WebP: the primary image is decoded once for all
+// still formats. An animated WebP still needs every frame, so it is encoded
+// from the container afterwards, once the decoded primary is released.
+static bool convert_formats(heif_context* ctx, const fs::path& output_path, const Options& opts,
+                            const std::vector<fs::path>& links) {
+    std::vector<OutputFormat> stills = opts.formats;
+    bool animate = false;
+    auto webp = std::find(stills.begin(), stills.end(), OutputFormat::WebP);
+    if (opts.animate && webp != stills.end() && 
+        heif_context_get_number_of_top_level_images(ctx) > 1) {
+        stills.erase(webp);
+        animate = true;
+    }
+
+    bool ok = true;
+    if (!stills.empty()) {
+        heif_item_id primary_id;
+        heif_error err = heif_context_get_primary_image_ID(ctx, &primary_id);
+        DecodedFrame frame;
+        ImageMetadata metadata;
+        if (err.code != heif_error_Ok) {
+            std::cerr << "❌ Failed to get image handle: " << err.message << std::endl;
+            ok = false;
+        } else {
+            ok = decode_image(ctx, primary_id, opts, frame, metadata) &&
+                 write_formats(frame, metadata, stills, output_path, opts, links);
+        }
+    }
+
+    if (animate) {
+        if (cancelled()) {
+            return false;
+        }
+        fs::path path = fs::path(output_path).replace_extension(".webp");
+        std::vector<fs::path> webp_links;
+        for (const auto& link : links) {
+            webp_links.push_back(fs::path(link).replace_extension(".webp"));
+        }
+        WebPData webp_data;
+        WebPDataInit(&webp_data);
+        ok = encode_heic(ctx, path, opts, &webp_data) && write_webp(path, webp_data, webp_links) && ok;
+        WebPDataClear(&webp_data);
+    }
+    return ok;
+}
+
+bool convert_image(heif_context* ctx, heif_item_id id, const fs::path& output_path,
+                   const Options& opts) {
+    TraceFile trace_file(output_path);
+    if (!webp_only(opts)) {
+        DecodedFrame frame;
+        ImageMetadata metadata;
+        return decode_image(ctx, id, opts, frame, metadata) &&
+               write_formats(frame, metadata, opts.formats, output_path, opts, {});
+    }
+
+    WebPData webp;
+    WebPDataInit(&webp);
+
+    bool ok = encode_image(ctx, id, output_path, opts, &webp) && write_webp(output_path, webp);
+    if (ok && opts.verbose) {
+        std::cout << "   Size: " << format_bytes(webp.size) << std::endl;
+    }
+
+    WebPDataClear(&webp);
+    return ok;
+}
+
+bool encode_heic(heif_context* ctx, const fs::path& output_path, const Options& opts,
+                 WebPData* out) {
+    bool encoded;
+
+    int image_count = heif_context_get_number_of_top_level_images(ctx);
+    if (opts.animate && image_count > 1) {
+        if (opts.verbose) {
+            std::cout << "🎞️  Encoding animated WebP (" << image_count << " frames): " 
+                      << output_path << std::endl;
+        }
+        encoded = encode_animation(ctx, opts, out);
+
+        // Animations carry the primary image's metadata
+        heif_image_handle* primary;
+        if (encoded && opts.metadata != kMetadataNone &&
+            heif_context_get_primary_image_handle(ctx, &primary).code == heif_error_Ok) {
+            ImageMetadata metadata;
+            read_metadata(primary, opts.metadata, metadata);
+            heif_image_handle_release(primary);
+            encoded = attach_metadata(metadata, opts, out);
+        }
+    } else {
+        heif_item_id primary_id;
+        heif_error err = heif_context_get_primary_image_ID(ctx, &primary_id);
+        if (err.code != heif_error_Ok) {
+            std::cerr << "❌ Failed to get image handle: " << err.message << std::endl;
+            return false;
+        }
+        encoded = encode_image(ctx, primary_id, output_path, opts, out);
+    }
+    return encoded;
+}
+
+// Shared tail of convert_heic_to_webp and convert_heic_data_to_webp
+static bool convert_opened(HeifContextPtr ctx, const fs::path& input_path,
+                           const fs::path& output_path, const Options& opts,
+                           const std::vector<fs::path>& links) {
+    if (!ctx || cancelled()) {
+        return false;
+    }
+    if (!webp_only(opts)) {
+        return convert_formats(ctx.get(), output_path, opts, links);
+    }
+
+    WebPData webp;
+    WebPDataInit(&webp);
+    bool encoded = encode_heic(ctx.get(), output_path, opts, &webp);
+    ctx.reset();
+
+    if (!encoded || !write_webp(output_path, webp, links)) {
+        WebPDataClear(&webp);
+        return false;
+    }
+
+    if (opts.verbose) {
+        size_t input_size = fs::file_size(input_path);
+        double ratio = (1.0 - static_cast<double>(webp.size) / input_size) * 100.0;
+        std::cout << "   Size: " << format_bytes(input_size) << " → " 
+                  << format_bytes(webp.size) << " (" << std::fixed 
+                  << std::setprecision(1) << ratio << "% smaller)" << std::endl;
+    }
+
+    // Cleanup
+    WebPDataClear(&webp);
+
+    return true;
+}
+
+bool convert_heic_to_webp(const fs::path& input_path, const fs::path& output_path, 
+                          const Options& opts, const std::vector<fs::path>& links) {
+    TraceFile trace_file(input_path);
+    if (opts.verbose) {
+        std::cout << "📸 Decoding: " << input_path << std::endl;
+    }
+    return convert_opened(open_heic(input_path), input_path, output_path, opts, links);
+}
+
+bool convert_heic_data_to_webp(const fs::path& input_path, std::shared_ptr<std::vector<uint8_t>> data,
+                               const fs::path& output_path, const Options& opts,
+                               const std::vector<fs::path>& links) {
+    TraceFile trace_file(input_path);
+    if (opts.verbose) {
+        std::cout << "📸 Decoding: " << input_path << std::endl;
+    }
+    return convert_opened(open_heic_buffer(std::move(data)), input_path, output_path, opts, links);
+}
@@ -0,0 +1,64 @@
+/**
+ * Conversion of a single HEIF container to WebP output files
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libheif/heif.h>
+#include <webp/mux_types.h>
+
+#include "options.h"
+#include "worker_pool.h"
+
+namespace fs = std::filesystem;
+
+struct WorkItem {
+    fs::path input;
+    fs::path output;
+    Priority priority = Priority::Bulk;
+    Deadline deadline = kNoDeadline;
+};
+
+// Parsed container; images of one file can be converted concurrently through it
+using HeifContextPtr = std::shared_ptr<heif_context>;
+
+std::string format_bytes(size_t bytes);
+
+// Returns null after reporting the error
+HeifContextPtr open_heic(const fs::path& input_path);
+
+// Parses an in-memory HEIF; the context keeps `data` alive
+HeifContextPtr open_heic_buffer(std::shared_ptr<std::vector<uint8_t>> data);
+
+// `links` receive the same file, e.g. the outputs of duplicate inputs
+bool write_webp(const fs::path& output_path, const WebPData& webp,
+                const std::vector<fs::path>& links = {});
+
+// Converts one image of an already opened container, into each of opts.formats
+bool convert_image(heif_context* ctx, heif_item_id id, const fs::path& output_path,
+                   const Options& opts);
+
+// Encodes the primary image, or every top-level image when animating, into
+// `out`; `output_path` only labels progress output
+bool encode_heic(heif_context* ctx, const fs::path& output_path, const Options& opts,
+                 WebPData* out);
+
+// Converts the primary image, or every top-level image when animating. The
+// result is also written to each of `links`. With opts.formats other than a
+// lone WebP, the primary image is decoded once and encoded into each format,
+// written next to `output_path` with the format's extension.
+bool convert_heic_to_webp(const fs::path& input_path, const fs::path& output_path, 
+                          const Options& opts, const std::vector<fs::path>& links = {});
+
+// convert_heic_to_webp for an input already read into `data`, e.g. by
+// read_file_async or group_duplicates; `input_path` labels output
+bool convert_heic_data_to_webp(const fs::path& input_path, std::shared_ptr<std::vector<uint8_t>> data,
+                               const fs::path& output_path, const Options& opts,
+                               const std::vector<fs::path>& links = {});
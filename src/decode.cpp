@@ -0,0 +1,127 @@
+/**
+ * HEIF image decoding into 8-bit interleaved RGB(A)
+ */
+
+#include "decode.h"
+
+#include <iostream>
+
+#include "adaptive.h"
+#include "trace.h"
+
+namespace {
+
+// 16x16 4:2:0 HEVC still image (a grey gradient), encoded with libheif/x265
+const uint8_t kWarmUpImage[] = {
+    0x00, 0x00, 0x00, 0x1c, 0x66, 0x74, 0x79, 0x70, 0x68, 0x65, 0x69, 0x63, 0x00, 0x00, 0x00, 0x00,
+    0x6d, 0x69, 0x66, 0x31, 0x68, 0x65, 0x69, 0x63, 0x6d, 0x69, 0x61, 0x66, 0x00, 0x00, 0x01, 0xaa,
+    0x6d, 0x65, 0x74, 0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x68, 0x64, 0x6c, 0x72,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70, 0x69, 0x63, 0x74, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x70, 0x69, 0x74,
+    0x6d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x10, 0x69, 0x64, 0x61, 0x74, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x10, 0x00, 0x00, 0x00, 0x38, 0x69, 0x6c, 0x6f, 0x63, 0x01,
+    0x00, 0x00, 0x00, 0x44, 0x40, 0x00, 0x02, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0xce, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x26, 0x00, 0x02, 0x00, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00,
+    0x00, 0x00, 0x38, 0x69, 0x69, 0x6e, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+    0x15, 0x69, 0x6e, 0x66, 0x65, 0x02, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x68, 0x76, 0x63,
+    0x31, 0x00, 0x00, 0x00, 0x00, 0x15, 0x69, 0x6e, 0x66, 0x65, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x67, 0x72, 0x69, 0x64, 0x00, 0x00, 0x00, 0x00, 0xd5, 0x69, 0x70, 0x72, 0x70, 0x00,
+    0x00, 0x00, 0xb3, 0x69, 0x70, 0x63, 0x6f, 0x00, 0x00, 0x00, 0x73, 0x68, 0x76, 0x63, 0x43, 0x01,
+    0x03, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1e, 0xf0, 0x00, 0xfc, 0xfd,
+    0xf8, 0xf8, 0x00, 0x00, 0x0f, 0x03, 0x20, 0x00, 0x01, 0x00, 0x18, 0x40, 0x01, 0x0c, 0x01, 0xff,
+    0xff, 0x03, 0x70, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x1e,
+    0xba, 0x02, 0x40, 0x21, 0x00, 0x01, 0x00, 0x27, 0x42, 0x01, 0x01, 0x03, 0x70, 0x00, 0x00, 0x03,
+    0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x1e, 0xa0, 0x20, 0x81, 0x05, 0x96, 0xea,
+    0xae, 0x9a, 0xe6, 0xc0, 0x80, 0x00, 0x00, 0x03, 0x00, 0x80, 0x00, 0x00, 0x03, 0x00, 0x84, 0x22,
+    0x00, 0x01, 0x00, 0x06, 0x44, 0x01, 0xc1, 0x73, 0xc1, 0x89, 0x00, 0x00, 0x00, 0x14, 0x69, 0x73,
+    0x70, 0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00,
+    0x00, 0x14, 0x69, 0x73, 0x70, 0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x10, 0x70, 0x69, 0x78, 0x69, 0x00, 0x00, 0x00, 0x00, 0x03, 0x08,
+    0x08, 0x08, 0x00, 0x00, 0x00, 0x1a, 0x69, 0x70, 0x6d, 0x61, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x02, 0x00, 0x01, 0x02, 0x81, 0x02, 0x00, 0x02, 0x02, 0x03, 0x84, 0x00, 0x00, 0x00, 0x1a,
+    0x69, 0x72, 0x65, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x64, 0x69, 0x6d, 0x67,
+    0x00, 0x02, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x2e, 0x6d, 0x64, 0x61, 0x74, 0x00, 0x00,
+    0x00, 0x22, 0x28, 0x01, 0xaf, 0x04, 0x12, 0x12, 0x55, 0x60, 0xf8, 0x09, 0xfd, 0x5d, 0x6c, 0x5a,
+    0x23, 0x3e, 0x7a, 0xb2, 0xa4, 0x2d, 0x43, 0x96, 0xfd, 0xf5, 0xba, 0xc9, 0x75, 0x43, 0x92, 0x84,
+    0xb7, 0x2d, 0x4b, 0x4c,
+};
+
+}  // namespace
+
+bool init_decoder() {
+    heif_error err = heif_init(nullptr);
+    if (err.code != heif_error_Ok) {
+        std::cerr << "❌ Failed to initialize libheif: " << err.message << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void warm_up_decoder() {
+    // Failures only cost the warm-up; the real decode reports its own errors
+    std::unique_ptr<heif_context, void (*)(heif_context*)> ctx(heif_context_alloc(), heif_context_free);
+    heif_error err = heif_context_read_from_memory_without_copy(ctx.get(), kWarmUpImage,
+                                                                sizeof(kWarmUpImage), nullptr);
+    heif_image_handle* handle;
+    if (err.code != heif_error_Ok ||
+        heif_context_get_primary_image_handle(ctx.get(), &handle).code != heif_error_Ok) {
+        return;
+    }
+
+    heif_image* img;
+    err = heif_decode_image(handle, &img, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
+    if (err.code == heif_error_Ok) {
+        heif_image_release(img);
+    }
+    heif_image_handle_release(handle);
+}
+
+bool decode_frame(const heif_image_handle* handle, const Options& opts, DecodedFrame& frame) {
+    // High bit-depth images are decoded at full precision and tone mapped below
+    frame.has_alpha = heif_image_handle_has_alpha_channel(handle) != 0;
+    bool high_bit_depth = heif_image_handle_get_luma_bits_per_pixel(handle) > 8;
+    heif_chroma chroma;
+    if (high_bit_depth) {
+        chroma = frame.has_alpha ? heif_chroma_interleaved_RRGGBBAA_LE : heif_chroma_interleaved_RRGGBB_LE;
+    } else {
+        chroma = frame.has_alpha ? heif_chroma_interleaved_RGBA : heif_chroma_interleaved_RGB;
+    }
+
+    heif_image* img;
+    heif_error err;
+    {
+        TraceSpan span(TraceStage::Decode);
+        err = heif_decode_image(handle, &img, heif_colorspace_RGB, chroma, nullptr);
+    }
+
+    if (err.code != heif_error_Ok) {
+        std::cerr << "❌ Failed to decode image: " << err.message << std::endl;
+        return false;
+    }
+
+    frame.image.reset(img, heif_image_release);
+    frame.width = heif_image_get_width(img, heif_channel_interleaved);
+    frame.height = heif_image_get_height(img, heif_channel_interleaved);
+    frame.pixels = heif_image_get_plane_readonly(img, heif_channel_interleaved, &frame.stride);
+    count_decoded_pixels(static_cast<uint64_t>(frame.width) * frame.height);
+
+    if (high_bit_depth) {
+        frame.bit_depth = heif_image_get_bits_per_pixel_range(img, heif_channel_interleaved);
+        frame.tone_map = resolve_tone_map(opts.tone_map, handle);
+
+        int channels = frame.has_alpha ? 4 : 3;
+        int mapped_stride = frame.width * channels;
+        frame.mapped.resize(static_cast<size_t>(mapped_stride) * frame.height);
+        TraceSpan span(TraceStage::Convert);
+        tone_map_to_8bit(frame.pixels, frame.stride, frame.mapped.data(), mapped_stride,
+                         frame.width, frame.height, channels, frame.bit_depth, frame.tone_map);
+
+        frame.image.reset();
+        frame.pixels = frame.mapped.data();
+        frame.stride = mapped_stride;
+    }
+
+    frame.memory.add(static_cast<size_t>(frame.stride) * frame.height);
+    return true;
+}
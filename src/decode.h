@@ -0,0 +1,39 @@
+/**
+ * HEIF image decoding into 8-bit interleaved RGB(A)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <libheif/heif.h>
+
+#include "metrics.h"
+#include "options.h"
+#include "tonemap.h"
+
+struct DecodedFrame {
+    std::shared_ptr<const heif_image> image;  // decoded planes, dropped once tone mapped
+    std::vector<uint8_t> mapped;              // 8-bit copy of high bit-depth sources
+    const uint8_t* pixels = nullptr;          // points into `image` or `mapped`
+    int stride = 0;
+    int width = 0;
+    int height = 0;
+    bool has_alpha = false;
+    int bit_depth = 8;
+    ToneMap tone_map = ToneMap::Clip;
+    MemoryCharge memory;                      // pixels, in the in-flight bytes gauge
+};
+
+// Loads libheif's decoder plugins; called once at startup before any worker runs
+bool init_decoder();
+
+// Decodes a tiny embedded HEIC on the calling thread so the first real image
+// doesn't pay for the decoder's lazy setup. Run once per worker thread.
+void warm_up_decoder();
+
+// Decodes `handle` to interleaved RGB, or RGBA when it has an alpha plane.
+// High bit-depth images are tone mapped to 8-bit according to `opts`.
+bool decode_frame(const heif_image_handle* handle, const Options& opts, DecodedFrame& frame);
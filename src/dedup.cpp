@@ -0,0 +1,157 @@
+/**
+ * Detection of byte-identical inputs, so each distinct file is converted once
+ */
+
+#include "dedup.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <system_error>
+
+#include "io_backend.h"
+
+namespace {
+
+constexpr uint64_t kSecret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull,
+};
+
+inline void multiply(uint64_t& a, uint64_t& b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    multiply(a, b);
+    return a ^ b;
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+}  // namespace
+
+uint64_t hash_bytes(const uint8_t* p, size_t len, uint64_t seed) {
+    seed ^= mix(seed ^ kSecret[0], kSecret[1]);
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t shift = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - shift);
+        } else if (len > 0) {
+            a = (uint64_t(p[0]) << 16) | (uint64_t(p[len >> 1]) << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p) ^ kSecret[1], read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ kSecret[2], read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ kSecret[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ kSecret[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    a ^= kSecret[1];
+    b ^= seed;
+    multiply(a, b);
+    return mix(a ^ kSecret[0] ^ len, b ^ kSecret[1]);
+}
+
+std::vector<DedupGroup> group_duplicates(const std::vector<WorkItem>& items, WorkerPool& pool) {
+    // Only files of one size can match, and sizes need no reads. Unreadable
+    // files stay in a group of their own.
+    std::vector<uint64_t> sizes(items.size());
+    std::map<uint64_t, std::vector<size_t>> by_size;
+    for (size_t i = 0; i < items.size(); i++) {
+        std::error_code ec;
+        uint64_t size = fs::file_size(items[i].input, ec);
+        if (!ec) {
+            sizes[i] = size;
+            by_size[size].push_back(i);
+        }
+    }
+
+    // Each file of a shared size is read once: the bytes are hashed, compared
+    // with an earlier file's only when the hashes match, and kept for the
+    // conversion when the file starts a group
+    struct Slot {
+        size_t primary;
+        std::shared_ptr<std::vector<uint8_t>> data;
+    };
+    std::vector<Slot> slots(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        slots[i].primary = i;
+    }
+    for (const auto& [size, bucket] : by_size) {
+        if (bucket.size() < 2) continue;
+        pool.submit([&, bucket = &bucket] {
+            std::multimap<uint64_t, size_t> primaries;  // hash -> item
+            for (size_t i : *bucket) {
+                auto data = std::make_shared<std::vector<uint8_t>>();
+                if (!read_file(items[i].input, *data)) continue;
+
+                uint64_t hash = hash_bytes(data->data(), data->size());
+                auto [first, last] = primaries.equal_range(hash);
+                auto match = std::find_if(first, last, [&](const auto& primary) {
+                    return *slots[primary.second].data == *data;
+                });
+                if (match != last) {
+                    slots[i].primary = match->second;
+                } else {
+                    primaries.emplace(hash, i);
+                    slots[i].data = std::move(data);
+                }
+            }
+        });
+    }
+    pool.wait();
+
+    // Primaries come before their duplicates, so groups keep the order of `items`
+    std::vector<DedupGroup> groups;
+    std::vector<size_t> group_of(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        if (slots[i].primary == i) {
+            group_of[i] = groups.size();
+            groups.push_back({items[i], {}, sizes[i], std::move(slots[i].data)});
+        } else {
+            groups[group_of[slots[i].primary]].duplicates.push_back(items[i]);
+        }
+    }
+    return groups;
+}
+
+double thread_cpu_seconds() {
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0.0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
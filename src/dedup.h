@@ -0,0 +1,34 @@
+/**
+ * Detection of byte-identical inputs, so each distinct file is converted once
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "convert.h"
+#include "worker_pool.h"
+
+// Fast non-cryptographic 64-bit hash (wyhash construction)
+uint64_t hash_bytes(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+struct DedupGroup {
+    WorkItem primary;
+    std::vector<WorkItem> duplicates;  // same bytes as `primary`
+    uint64_t size = 0;                 // input bytes per copy
+    // The primary's bytes, when grouping had to read them, for the conversion
+    std::shared_ptr<std::vector<uint8_t>> data;
+};
+
+// Groups identical files on `pool`, keeping the order of `items`. Files of a
+// size no other input has are not read. The others are read once and hashed;
+// a hash match is confirmed by comparing bytes. Files that start a group keep
+// their bytes until converted. Unreadable files get a group of their own, so
+// their conversion reports the error.
+std::vector<DedupGroup> group_duplicates(const std::vector<WorkItem>& items, WorkerPool& pool);
+
+// CPU time consumed by the calling thread, for the saved-work estimate
+double thread_cpu_seconds();
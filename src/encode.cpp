@@ -0,0 +1,85 @@
+/**
+ * WebP encoding of decoded frames
+ */
+
+#include "encode.h"
+
+#include "cancel.h"
+#include "pixel_kernels.h"
+#include "trace.h"
+
+bool init_webp_config(const Options& opts, WebPConfig& config) {
+    if (!WebPConfigInit(&config)) {
+        return false;
+    }
+    config.quality = static_cast<float>(opts.quality);
+    config.method = opts.method;
+    config.alpha_quality = opts.alpha_quality;
+    config.alpha_filtering = opts.alpha_filter;
+    config.use_sharp_yuv = opts.sharp_yuv;
+    return true;
+}
+
+bool import_frame(const DecodedFrame& frame, bool argb, WebPPicture& pic) {
+    TraceSpan span(TraceStage::Convert);
+    pic.width = frame.width;
+    pic.height = frame.height;
+    pic.use_argb = argb;
+
+    // Alpha frames keep libwebp's import, which weights chroma by alpha
+    if (argb || frame.has_alpha) {
+        int imported = frame.has_alpha ? WebPPictureImportRGBA(&pic, frame.pixels, frame.stride)
+                                       : WebPPictureImportRGB(&pic, frame.pixels, frame.stride);
+        return imported != 0;
+    }
+
+    // Opaque images are converted by our own kernel, so no alpha plane is built
+    pic.colorspace = WEBP_YUV420;
+    if (!WebPPictureAlloc(&pic)) {
+        return false;
+    }
+    select_kernels({3, 8}).rgb_to_yuv420(frame.pixels, frame.stride, frame.width, frame.height,
+                                         pic.y, pic.y_stride, pic.u, pic.v, pic.uv_stride);
+    return true;
+}
+
+// Lets a cancelled run abandon large encodes part way through
+static int abort_if_cancelled(int, const WebPPicture*) {
+    return cancelled() ? 0 : 1;
+}
+
+bool encode_webp(const DecodedFrame& frame, const Options& opts, WebPData* out) {
+    WebPConfig config;
+    if (!init_webp_config(opts, config)) {
+        return false;
+    }
+
+    WebPPicture pic;
+    if (!WebPPictureInit(&pic)) {
+        return false;
+    }
+
+    WebPMemoryWriter writer;
+    WebPMemoryWriterInit(&writer);
+    pic.writer = WebPMemoryWrite;
+    pic.custom_ptr = &writer;
+
+    // Sharp YUV runs inside WebPEncode and only on ARGB pictures
+    bool encoded = import_frame(frame, opts.sharp_yuv, pic);
+    if (encoded) {
+        TraceSpan span(TraceStage::Encode);
+        pic.progress_hook = abort_if_cancelled;
+        encoded = WebPEncode(&config, &pic);
+    }
+    if (!encoded) {
+        WebPPictureFree(&pic);
+        WebPMemoryWriterClear(&writer);
+        return false;
+    }
+    WebPPictureFree(&pic);
+
+    // The writer buffer comes from WebPMalloc, so WebPDataClear can release it
+    out->bytes = writer.mem;
+    out->size = writer.size;
+    return true;
+}
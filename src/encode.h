@@ -0,0 +1,21 @@
+/**
+ * WebP encoding of decoded frames
+ */
+
+#pragma once
+
+#include <webp/encode.h>
+#include <webp/mux_types.h>
+
+#include "decode.h"
+#include "options.h"
+
+bool init_webp_config(const Options& opts, WebPConfig& config);
+
+// Imports `frame` into an initialized picture. With `argb` the picture keeps
+// ARGB pixels for the encoder to convert (needed for sharp YUV and animation);
+// otherwise opaque frames go straight to YUV 4:2:0 and skip the alpha plane.
+bool import_frame(const DecodedFrame& frame, bool argb, WebPPicture& pic);
+
+// Encodes a still image; on success `out` owns a buffer released with WebPDataClear
+bool encode_webp(const DecodedFrame& frame, const Options& opts, WebPData* out);
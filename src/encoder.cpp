@@ -0,0 +1,361 @@
+/**
+ * Output encoders: one still-image encoder per output format
+ */
+
+#include "encoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include <jpeglib.h>
+#include <libheif/heif.h>
+#include <png.h>
+
+#include "decode.h"
+#include "encode.h"
+#include "metadata.h"
+#include "options.h"
+#include "trace.h"
+
+namespace {
+
+// ---- WebP ------------------------------------------------------------------
+
+bool encode_webp_file(const DecodedFrame& frame, const ImageMetadata& metadata,
+                      const Options& opts, std::vector<uint8_t>& out) {
+    WebPData webp;
+    WebPDataInit(&webp);
+    if (!encode_webp(frame, opts, &webp)) {
+        std::cerr << "❌ Failed to encode WebP" << std::endl;
+        return false;
+    }
+    if (!metadata.empty() && !mux_metadata(metadata, &webp)) {
+        std::cerr << "❌ Failed to add metadata to WebP" << std::endl;
+        WebPDataClear(&webp);
+        return false;
+    }
+    out.assign(webp.bytes, webp.bytes + webp.size);
+    WebPDataClear(&webp);
+    return true;
+}
+
+// ---- JPEG ------------------------------------------------------------------
+
+// APP1 payloads are limited to 65533 bytes including their signature
+constexpr size_t kMaxMarkerData = 65533;
+constexpr char kExifSignature[] = "Exif\0";                          // 6 bytes with the NUL
+constexpr char kXmpSignature[] = "http://ns.adobe.com/xap/1.0/";  // 29 bytes with the NUL
+
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr cinfo) {
+    auto* err = reinterpret_cast<JpegError*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    std::longjmp(err->jump, 1);
+}
+
+void write_app1(jpeg_compress_struct* cinfo, const char* signature, size_t signature_size,
+                const std::vector<uint8_t>& data, const char* name) {
+    if (data.empty()) return;
+    if (signature_size + data.size() > kMaxMarkerData) {
+        std::cerr << "⚠️  " << name << " too large for JPEG, dropped" << std::endl;
+        return;
+    }
+    jpeg_write_m_header(cinfo, JPEG_APP0 + 1, static_cast<unsigned>(signature_size + data.size()));
+    for (size_t i = 0; i < signature_size; i++) {
+        jpeg_write_m_byte(cinfo, signature[i]);
+    }
+    for (uint8_t byte : data) {
+        jpeg_write_m_byte(cinfo, byte);
+    }
+}
+
+// Everything between setjmp and the end stays in plain C types, so a libjpeg
+// error longjmp-ing back skips no destructors. `rgb` is a row of scratch space
+// for flattening alpha.
+bool compress_jpeg(jpeg_compress_struct* cinfo, JpegError* err, const DecodedFrame& frame,
+                   const ImageMetadata& metadata, const Options& opts, uint8_t* rgb,
+                   unsigned char** mem, unsigned long* size) {
+    if (setjmp(err->jump)) {
+        return false;
+    }
+    jpeg_create_compress(cinfo);
+    jpeg_mem_dest(cinfo, mem, size);
+
+    cinfo->image_width = static_cast<JDIMENSION>(frame.width);
+    cinfo->image_height = static_cast<JDIMENSION>(frame.height);
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, opts.quality, TRUE);
+    // Method 0 trades a few percent of size for speed, as with WebP
+    cinfo->optimize_coding = opts.method > 0;
+    cinfo->dct_method = opts.method > 0 ? JDCT_ISLOW : JDCT_IFAST;
+    jpeg_start_compress(cinfo, TRUE);
+
+    write_app1(cinfo, kExifSignature, sizeof(kExifSignature), metadata.exif, "EXIF");
+    write_app1(cinfo, kXmpSignature, sizeof(kXmpSignature), metadata.xmp, "XMP");
+    if (!metadata.icc.empty()) {
+        jpeg_write_icc_profile(cinfo, metadata.icc.data(), static_cast<unsigned>(metadata.icc.size()));
+    }
+
+    for (int y = 0; y < frame.height; y++) {
+        const uint8_t* src = frame.pixels + static_cast<size_t>(y) * frame.stride;
+        JSAMPROW row = const_cast<JSAMPROW>(src);
+        if (frame.has_alpha) {
+            // JPEG has no alpha; composite onto white so transparent areas
+            // don't show whatever colour the encoder left under them
+            for (int x = 0; x < frame.width; x++) {
+                unsigned a = src[4 * x + 3];
+                for (int c = 0; c < 3; c++) {
+                    rgb[3 * x + c] = static_cast<uint8_t>((src[4 * x + c] * a + 255 * (255 - a) + 127) / 255);
+                }
+            }
+            row = rgb;
+        }
+        jpeg_write_scanlines(cinfo, &row, 1);
+    }
+    jpeg_finish_compress(cinfo);
+    return true;
+}
+
+bool encode_jpeg_file(const DecodedFrame& frame, const ImageMetadata& metadata,
+                      const Options& opts, std::vector<uint8_t>& out) {
+    TraceSpan span(TraceStage::Encode);
+    std::vector<uint8_t> rgb(frame.has_alpha ? static_cast<size_t>(frame.width) * 3 : 0);
+
+    jpeg_compress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpeg_error_exit;
+    unsigned char* mem = nullptr;
+    unsigned long size = 0;
+
+    bool ok = compress_jpeg(&cinfo, &err, frame, metadata, opts, rgb.data(), &mem, &size);
+    jpeg_destroy_compress(&cinfo);
+    if (ok) {
+        out.assign(mem, mem + size);
+    } else {
+        std::cerr << "❌ Failed to encode JPEG: " << err.message << std::endl;
+    }
+    std::free(mem);
+    return ok;
+}
+
+// ---- PNG -------------------------------------------------------------------
+
+struct PngState {
+    std::vector<uint8_t>* out;
+    char message[256];
+};
+
+void png_error_fn(png_structp png, png_const_charp message) {
+    auto* state = static_cast<PngState*>(png_get_error_ptr(png));
+    std::snprintf(state->message, sizeof(state->message), "%s", message);
+    png_longjmp(png, 1);
+}
+
+void png_warning_fn(png_structp, png_const_charp) {
+}
+
+void png_write_fn(png_structp png, png_bytep data, png_size_t length) {
+    auto* state = static_cast<PngState*>(png_get_io_ptr(png));
+    state->out->insert(state->out->end(), data, data + length);
+}
+
+// As with JPEG, nothing with a destructor lives between setjmp and return.
+// `xmp_text` is the XMP packet as a C string, since libpng takes text by strlen.
+bool compress_png(png_structp png, png_infop info, const DecodedFrame& frame,
+                  const ImageMetadata& metadata, const char* xmp_text, const Options& opts) {
+    if (setjmp(png_jmpbuf(png))) {
+        return false;
+    }
+
+    png_set_IHDR(png, info, static_cast<png_uint_32>(frame.width),
+                 static_cast<png_uint_32>(frame.height), 8,
+                 frame.has_alpha ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Method 0 asks for speed; zlib level 1 is several times faster than 6
+    png_set_compression_level(png, opts.method > 0 ? 6 : 1);
+
+    if (!metadata.icc.empty()) {
+        png_set_iCCP(png, info, "ICC Profile", PNG_COMPRESSION_TYPE_BASE, metadata.icc.data(),
+                     static_cast<png_uint_32>(metadata.icc.size()));
+    }
+#ifdef PNG_eXIf_SUPPORTED
+    if (!metadata.exif.empty()) {
+        png_set_eXIf_1(png, info, static_cast<png_uint_32>(metadata.exif.size()),
+                       const_cast<png_bytep>(metadata.exif.data()));
+    }
+#endif
+    png_text xmp = {};
+    if (*xmp_text) {
+        xmp.compression = PNG_ITXT_COMPRESSION_NONE;
+        xmp.key = const_cast<png_charp>("XML:com.adobe.xmp");
+        xmp.text = const_cast<png_charp>(xmp_text);
+        png_set_text(png, info, &xmp, 1);
+    }
+
+    png_write_info(png, info);
+    for (int y = 0; y < frame.height; y++) {
+        png_write_row(png, frame.pixels + static_cast<size_t>(y) * frame.stride);
+    }
+    png_write_end(png, info);
+    return true;
+}
+
+bool encode_png_file(const DecodedFrame& frame, const ImageMetadata& metadata,
+                     const Options& opts, std::vector<uint8_t>& out) {
+    TraceSpan span(TraceStage::Encode);
+    std::string xmp_text(metadata.xmp.begin(), metadata.xmp.end());
+    PngState state = {&out, "out of memory"};
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, &state, png_error_fn,
+                                              png_warning_fn);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    bool ok = info != nullptr;
+    if (ok) {
+        png_set_write_fn(png, &state, png_write_fn, nullptr);
+        ok = compress_png(png, info, frame, metadata, xmp_text.c_str(), opts);
+    }
+    png_destroy_write_struct(&png, &info);
+    if (!ok) {
+        std::cerr << "❌ Failed to encode PNG: " << state.message << std::endl;
+    }
+    return ok;
+}
+
+// ---- AVIF ------------------------------------------------------------------
+
+heif_error append_output(heif_context*, const void* data, size_t size, void* userdata) {
+    auto* out = static_cast<std::vector<uint8_t>*>(userdata);
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + size);
+    return heif_error{heif_error_Ok, heif_suberror_Unspecified, "Success"};
+}
+
+bool encode_avif_file(const DecodedFrame& frame, const ImageMetadata& metadata,
+                      const Options& opts, std::vector<uint8_t>& out) {
+    TraceSpan span(TraceStage::Encode);
+    std::unique_ptr<heif_context, void (*)(heif_context*)> ctx(heif_context_alloc(),
+                                                               heif_context_free);
+    heif_encoder* encoder = nullptr;
+    heif_image* image = nullptr;
+    heif_image_handle* handle = nullptr;
+
+    auto fail = [&](const heif_error& err) {
+        std::cerr << "❌ Failed to encode AVIF: " << err.message << std::endl;
+        if (handle) heif_image_handle_release(handle);
+        if (image) heif_image_release(image);
+        if (encoder) heif_encoder_release(encoder);
+        return false;
+    };
+
+    heif_error err = heif_context_get_encoder_for_format(ctx.get(), heif_compression_AV1, &encoder);
+    if (err.code != heif_error_Ok) return fail(err);
+    heif_encoder_set_lossy_quality(encoder, opts.quality);
+    // AV1 encoders take a speed of 0 (slowest) to 9; not every plugin has
+    // the parameter, so failing to set it is fine
+    heif_encoder_set_parameter_integer(encoder, "speed", std::clamp(9 - opts.method, 0, 9));
+
+    err = heif_image_create(frame.width, frame.height, heif_colorspace_RGB,
+                            frame.has_alpha ? heif_chroma_interleaved_RGBA : heif_chroma_interleaved_RGB,
+                            &image);
+    if (err.code != heif_error_Ok) return fail(err);
+    err = heif_image_add_plane(image, heif_channel_interleaved, frame.width, frame.height, 8);
+    if (err.code != heif_error_Ok) return fail(err);
+
+    int stride;
+    uint8_t* plane = heif_image_get_plane(image, heif_channel_interleaved, &stride);
+    size_t row_bytes = static_cast<size_t>(frame.width) * (frame.has_alpha ? 4 : 3);
+    for (int y = 0; y < frame.height; y++) {
+        std::memcpy(plane + static_cast<size_t>(y) * stride,
+                    frame.pixels + static_cast<size_t>(y) * frame.stride, row_bytes);
+    }
+
+    if (!metadata.icc.empty()) {
+        err = heif_image_set_raw_color_profile(image, "prof", metadata.icc.data(), metadata.icc.size());
+        if (err.code != heif_error_Ok) return fail(err);
+    }
+
+    err = heif_context_encode_image(ctx.get(), image, encoder, nullptr, &handle);
+    if (err.code != heif_error_Ok) return fail(err);
+    if (!metadata.exif.empty()) {
+        err = heif_context_add_exif_metadata(ctx.get(), handle, metadata.exif.data(),
+                                             static_cast<int>(metadata.exif.size()));
+        if (err.code != heif_error_Ok) return fail(err);
+    }
+    if (!metadata.xmp.empty()) {
+        err = heif_context_add_XMP_metadata(ctx.get(), handle, metadata.xmp.data(),
+                                            static_cast<int>(metadata.xmp.size()));
+        if (err.code != heif_error_Ok) return fail(err);
+    }
+
+    heif_writer writer = {1, append_output};
+    err = heif_context_write(ctx.get(), &writer, &out);
+    if (err.code != heif_error_Ok) return fail(err);
+
+    heif_image_handle_release(handle);
+    heif_image_release(image);
+    heif_encoder_release(encoder);
+    return true;
+}
+
+// Indexed by OutputFormat
+const Encoder kEncoders[] = {
+    {"WebP", ".webp", encode_webp_file},
+    {"JPEG", ".jpg", encode_jpeg_file},
+    {"PNG", ".png", encode_png_file},
+    {"AVIF", ".avif", encode_avif_file},
+};
+
+}  // namespace
+
+bool parse_output_formats(const std::string& list, std::vector<OutputFormat>& out) {
+    std::vector<OutputFormat> formats;
+    size_t start = 0;
+    for (;;) {
+        size_t comma = list.find(',', start);
+        std::string name = list.substr(start, comma - start);
+
+        OutputFormat format;
+        if (name == "webp") {
+            format = OutputFormat::WebP;
+        } else if (name == "jpeg" || name == "jpg") {
+            format = OutputFormat::Jpeg;
+        } else if (name == "png") {
+            format = OutputFormat::Png;
+        } else if (name == "avif") {
+            format = OutputFormat::Avif;
+        } else {
+            return false;
+        }
+        if (std::find(formats.begin(), formats.end(), format) == formats.end()) {
+            formats.push_back(format);
+        }
+
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    out = std::move(formats);
+    return true;
+}
+
+const Encoder& encoder_for(OutputFormat format) {
+    return kEncoders[static_cast<int>(format)];
+}
+
+bool encoder_available(OutputFormat format) {
+    if (format == OutputFormat::Avif) {
+        return heif_have_encoder_for_format(heif_compression_AV1) != 0;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+/**
+ * Output encoders: one still-image encoder per output format
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct DecodedFrame;
+struct ImageMetadata;
+struct Options;
+
+enum class OutputFormat {
+    WebP,
+    Jpeg,  // libjpeg(-turbo); alpha is flattened onto white
+    Png,   // libpng, lossless
+    Avif,  // libheif's AV1 encoder
+};
+
+// Parses a comma separated list of webp, jpeg (or jpg), png and avif, e.g.
+// "webp,jpeg". Order is kept and repeats are dropped.
+bool parse_output_formats(const std::string& list, std::vector<OutputFormat>& out);
+
+// Encodes `frame` with the selected `metadata` embedded into `out`, using
+// opts.quality and, as encoder effort, opts.method. Reports its own errors.
+using EncodeFn = bool (*)(const DecodedFrame& frame, const ImageMetadata& metadata,
+                          const Options& opts, std::vector<uint8_t>& out);
+
+struct Encoder {
+    const char* name;       // as in --formats and progress output
+    const char* extension;  // of output files, with the dot
+    EncodeFn encode;
+};
+
+const Encoder& encoder_for(OutputFormat format);
+
+// False when the libraries at hand can't encode `format`, i.e. AVIF with a
+// libheif built without an AV1 encoder. Call after init_decoder().
+bool encoder_available(OutputFormat format);
@@ -0,0 +1,143 @@
+/**
+ * Streaming reader for --files-from lists
+ */
+
+#include "file_list.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "cancel.h"
+
+namespace {
+
+constexpr size_t kReadSize = 64 * 1024;
+
+void emit_record(const std::string& record, const std::function<void(WorkItem)>& emit) {
+    std::string line = record;
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    if (line.empty()) {
+        return;
+    }
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == std::string::npos) break;
+        start = tab + 1;
+    }
+
+    WorkItem item{fields[0], fields.size() > 1 ? fs::path(fields[1]) : fs::path()};
+    if (fields.size() > 2 && !fields[2].empty() && !parse_priority(fields[2], item.priority)) {
+        std::cerr << "⚠️  Unknown priority \"" << fields[2] << "\" for " << fields[0] 
+                  << ", using bulk" << std::endl;
+    }
+    if (fields.size() > 3 && !fields[3].empty()) {
+        char* end;
+        long ms = strtol(fields[3].c_str(), &end, 10);
+        if (*end != '\0' || ms < 0) {
+            std::cerr << "⚠️  Invalid deadline \"" << fields[3] << "\" for " << fields[0] 
+                      << ", ignoring it" << std::endl;
+        } else {
+            item.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        }
+    }
+    emit(std::move(item));
+}
+
+}  // namespace
+
+bool read_file_list(const std::string& source, const std::function<void(WorkItem)>& emit) {
+    int fd = source == "-" ? STDIN_FILENO : ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "❌ Failed to open file list: " << source << std::endl;
+        return false;
+    }
+
+    bool nul_separated = false;
+    bool ok = true;
+    std::string pending;
+    char buf[kReadSize];
+
+    auto split = [&](const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            char c = data[i];
+            if (c == '\0' && !nul_separated) {
+                nul_separated = true;
+            }
+            if (c == '\0' || (c == '\n' && !nul_separated)) {
+                emit_record(pending, emit);
+                pending.clear();
+            } else {
+                pending += c;
+            }
+        }
+    };
+
+    // The separator is picked from the first block that ends a record, before
+    // anything is split: a newline ahead of the first NUL is part of a path
+    std::string head;
+    bool separator_known = false;
+
+    for (;;) {
+        // A stop request ends the list, even while a pipe's writer is idle
+        if (stop_fd() >= 0) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {stop_fd(), POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0 && errno != EINTR) {
+                std::cerr << "❌ Failed to read file list: " << source << std::endl;
+                ok = false;
+                break;
+            }
+        }
+        if (stop_requested()) {
+            head.clear();
+            pending.clear();
+            break;
+        }
+
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "❌ Failed to read file list: " << source << std::endl;
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        if (separator_known) {
+            split(buf, static_cast<size_t>(n));
+            continue;
+        }
+        head.append(buf, static_cast<size_t>(n));
+        if (head.find('\0') != std::string::npos) {
+            nul_separated = true;
+        } else if (head.find('\n') == std::string::npos) {
+            continue;
+        }
+        separator_known = true;
+        split(head.data(), head.size());
+        head.clear();
+    }
+
+    // The last record doesn't need a terminator
+    split(head.data(), head.size());
+    emit_record(pending, emit);
+
+    if (fd != STDIN_FILENO) {
+        ::close(fd);
+    }
+    return ok;
+}
@@ -0,0 +1,23 @@
+/**
+ * Streaming reader for --files-from lists
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "convert.h"
+
+// Reads records from `source` ("-" for stdin) and calls `emit` for each one as
+// soon as it is complete, so conversion can start while the list is still
+// being written. Records end with a newline or NUL. The separator is picked
+// before the first record is split: NUL if the data read up to the first
+// terminator holds one, which allows newlines inside paths; and once a NUL is
+// seen later, only NUL ends records. A record is
+// "<input>" or "<input>\t<output>"; without an output, `output` is left empty.
+// Two optional fields follow: a priority class ("interactive" or "bulk") and
+// a deadline in milliseconds from when the record is read, e.g.
+// "in.heic\t\tinteractive\t500". A stop request (cancel.h) ends the list
+// early: records already read are still emitted, a partial last one is not.
+bool read_file_list(const std::string& source, const std::function<void(WorkItem)>& emit);
@@ -0,0 +1,654 @@
+/**
+ * File I/O backend: blocking pread/pwrite or batched io_uring submissions
+ */
+
+#include "io_backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HEIC2WEBP_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace {
+
+// Large files are split so one request never monopolizes the ring
+constexpr size_t kChunkSize = 1 << 20;
+
+bool pread_all(int fd, uint8_t* data, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+bool pwrite_all(int fd, const uint8_t* data, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+#ifdef HEIC2WEBP_IO_URING
+
+struct UringOp;
+
+struct UringChunk {
+    UringOp* op;
+    iovec iov;
+    off_t offset;
+    int result = 0;
+    bool completed = false;  // reaped, or failed with the ring
+};
+
+// One whole-file transfer. `complete` runs once, after the last chunk is
+// reaped or failed; after that nothing in the backend refers to the op.
+struct UringOp {
+    std::vector<UringChunk> chunks;
+    std::atomic<size_t> remaining{0};
+    size_t published = 0;  // chunks handed to the kernel, under submit_mutex_
+    std::function<void()> complete;
+};
+
+// The completion may free the op, its own storage included, so it runs from
+// a local copy
+void complete(UringOp& op) {
+    std::function<void()> on_complete = std::move(op.complete);
+    on_complete();
+}
+
+class Uring {
+public:
+    ~Uring();
+
+    bool init(unsigned depth);
+
+    // Submits the chunks of `op`, as many per io_uring_enter call as there are
+    // free slots. Once the ring has failed, chunks not yet submitted fail with
+    // its errno instead.
+    void submit(UringOp& op, int fd, uint8_t opcode);
+
+    // False once io_uring_enter has failed for good; new transfers then go to
+    // pread/pwrite
+    bool usable();
+
+    // Caps submissions in flight below the ring size
+    void set_limit(unsigned limit);
+    unsigned limit();
+
+private:
+    void reap();
+    void fail_in_flight(int error);
+    bool fail_unsubmitted_locked(UringOp& op, size_t first, int error);
+    bool stop_reaper();
+
+    int fd_ = -1;
+    unsigned depth_ = 0;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::mutex submit_mutex_;
+    std::condition_variable slots_cv_;
+    unsigned in_flight_ = 0;  // bounded by depth_ so the CQ ring can't overflow
+    unsigned limit_ = 0;      // 1..depth_
+    int dead_error_ = 0;      // errno of the failure that killed the ring, 0 while usable
+    bool reaper_exited_ = false;
+    std::unordered_set<UringOp*> ops_;  // with chunks in the kernel
+    std::thread completion_thread_;
+};
+
+int uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                                      nullptr, 0));
+}
+
+bool Uring::init(unsigned depth) {
+    io_uring_params params = {};
+    fd_ = uring_setup(depth, &params);
+    if (fd_ < 0) return false;
+    depth_ = params.sq_entries;
+    limit_ = depth_;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        return false;
+    }
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<uint8_t*>(sq_ring_);
+    auto* cq = static_cast<uint8_t*>(cq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    completion_thread_ = std::thread(&Uring::reap, this);
+    return true;
+}
+
+Uring::~Uring() {
+    if (completion_thread_.joinable()) {
+        if (!stop_reaper()) {
+            // It may be blocked in io_uring_enter for good; leave it the rings
+            completion_thread_.detach();
+            return;
+        }
+        completion_thread_.join();
+    }
+    if (sqes_) ::munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) ::munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+// A NOP with no owner tells the completion thread to exit. It is posted even
+// on a dead ring, whose failure may have been passing.
+bool Uring::stop_reaper() {
+    static UringChunk stop{nullptr, {}, 0};
+    std::unique_lock<std::mutex> lock(submit_mutex_);
+    slots_cv_.wait(lock, [this] { return dead_error_ != 0 || in_flight_ < depth_; });
+    if (reaper_exited_) {
+        return true;
+    }
+
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    *sqe = {};
+    sqe->opcode = IORING_OP_NOP;
+    sqe->fd = -1;
+    sqe->user_data = reinterpret_cast<uint64_t>(&stop);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    in_flight_++;
+
+    for (;;) {
+        int ret = uring_enter(fd_, 1, 0, 0);
+        if (ret == 1) return true;
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) continue;
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+}
+
+bool Uring::usable() {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    return dead_error_ == 0;
+}
+
+// Fails chunks [first, end) of `op`, which were never submitted. Returns true
+// when that completes the op; the caller runs `complete` outside the lock.
+bool Uring::fail_unsubmitted_locked(UringOp& op, size_t first, int error) {
+    for (size_t i = first; i < op.chunks.size(); i++) {
+        op.chunks[i].result = -error;
+        op.chunks[i].completed = true;
+    }
+    if ((op.remaining -= op.chunks.size() - first) != 0) {
+        return false;
+    }
+    ops_.erase(&op);
+    return true;
+}
+
+void Uring::submit(UringOp& op, int fd, uint8_t opcode) {
+    op.remaining = op.chunks.size();
+    op.published = 0;
+
+    // Once its last chunk is in the kernel the op may complete and be freed at
+    // any time, so it is only touched under submit_mutex_, which reap() takes
+    // before completing an op
+    for (;;) {
+        std::unique_lock<std::mutex> lock(submit_mutex_);
+        slots_cv_.wait(lock, [this] { return dead_error_ != 0 || in_flight_ < limit_; });
+        if (dead_error_ != 0) {
+            bool finished = fail_unsubmitted_locked(op, op.published, dead_error_);
+            lock.unlock();
+            if (finished) complete(op);
+            return;
+        }
+
+        // Fill as many SQEs as there are free slots, then submit them together
+        unsigned batch = static_cast<unsigned>(
+            std::min<size_t>(op.chunks.size() - op.published, limit_ - in_flight_));
+        unsigned tail = *sq_tail_;
+        for (unsigned i = 0; i < batch; i++) {
+            UringChunk& chunk = op.chunks[op.published + i];
+            unsigned index = tail & *sq_mask_;
+            io_uring_sqe* sqe = &sqes_[index];
+            *sqe = {};
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->off = static_cast<uint64_t>(chunk.offset);
+            sqe->addr = reinterpret_cast<uint64_t>(&chunk.iov);
+            sqe->len = 1;
+            sqe->user_data = reinterpret_cast<uint64_t>(&chunk);
+            sq_array_[index] = index;
+            tail++;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        in_flight_ += batch;
+        ops_.insert(&op);
+
+        unsigned submitted = 0;
+        while (submitted < batch) {
+            int ret = uring_enter(fd_, batch - submitted, 0, 0);
+            if (ret >= 0) {
+                submitted += static_cast<unsigned>(ret);
+                continue;
+            }
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+
+            // The ring is unusable. Take back the SQEs the kernel hasn't consumed,
+            // or the next submission would hand it chunks of an op whose caller
+            // has returned. Only SQEs published under submit_mutex_ are pending.
+            // Chunks already in the kernel still complete through reap(), so the
+            // op only completes once nothing refers to it any more.
+            dead_error_ = errno;
+            unsigned unsubmitted = batch - submitted;
+            __atomic_store_n(sq_tail_, tail - unsubmitted, __ATOMIC_RELEASE);
+            in_flight_ -= unsubmitted;
+            op.published += submitted;
+            bool finished = fail_unsubmitted_locked(op, op.published, dead_error_);
+            lock.unlock();
+            slots_cv_.notify_all();
+            if (finished) complete(op);
+            return;
+        }
+        op.published += batch;
+        if (op.published == op.chunks.size()) {
+            return;
+        }
+    }
+}
+
+void Uring::set_limit(unsigned limit) {
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex_);
+        limit_ = std::clamp(limit, 1u, depth_);
+    }
+    slots_cv_.notify_all();
+}
+
+unsigned Uring::limit() {
+    std::lock_guard<std::mutex> lock(submit_mutex_);
+    return limit_;
+}
+
+void Uring::reap() {
+    for (;;) {
+        int ret = uring_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            fail_in_flight(errno);
+            return;
+        }
+
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned reaped = 0;
+        bool stop = false;
+        std::vector<UringOp*> finished;
+
+        for (; head != tail; head++, reaped++) {
+            io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+            auto* chunk = reinterpret_cast<UringChunk*>(cqe->user_data);
+            if (!chunk->op) {
+                stop = true;
+                continue;
+            }
+            chunk->result = cqe->res;
+            chunk->completed = true;
+            if (--chunk->op->remaining == 0) {
+                finished.push_back(chunk->op);
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            in_flight_ -= reaped;
+            for (UringOp* op : finished) {
+                ops_.erase(op);
+            }
+            reaper_exited_ = stop;
+        }
+        slots_cv_.notify_all();
+        for (UringOp* op : finished) {
+            complete(*op);
+        }
+        if (stop) return;
+    }
+}
+
+// The completion thread can't wait for CQEs any more: the ring is dead. Every
+// chunk in the kernel is failed with `error` so no caller waits forever, and
+// submitters fail the chunks they still hold. Later transfers use pread/pwrite.
+void Uring::fail_in_flight(int error) {
+    std::vector<UringOp*> finished;
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex_);
+        if (dead_error_ == 0) {
+            dead_error_ = error;
+        }
+        reaper_exited_ = true;
+        for (UringOp* op : ops_) {
+            size_t failed = 0;
+            for (size_t i = 0; i < op->published; i++) {
+                UringChunk& chunk = op->chunks[i];
+                if (!chunk.completed) {
+                    chunk.result = -error;
+                    chunk.completed = true;
+                    failed++;
+                }
+            }
+            if (failed > 0 && (op->remaining -= failed) == 0) {
+                finished.push_back(op);
+            }
+        }
+        for (UringOp* op : finished) {
+            ops_.erase(op);
+        }
+        in_flight_ = 0;
+    }
+    slots_cv_.notify_all();
+    for (UringOp* op : finished) {
+        complete(*op);
+    }
+}
+
+std::unique_ptr<Uring> uring;
+
+void add_chunks(UringOp& op, uint8_t* data, size_t size) {
+    for (size_t offset = 0; offset < size; offset += kChunkSize) {
+        UringChunk chunk;
+        chunk.op = &op;
+        chunk.iov.iov_base = data + offset;
+        chunk.iov.iov_len = std::min(kChunkSize, size - offset);
+        chunk.offset = static_cast<off_t>(offset);
+        op.chunks.push_back(chunk);
+    }
+}
+
+// Finishes short transfers of a completed op with pread/pwrite, and chunks
+// failed along with a dead ring too
+bool finish_chunks(const UringOp& op, int fd, uint8_t opcode) {
+    bool ring_failed = !uring->usable();
+    for (const UringChunk& chunk : op.chunks) {
+        size_t want = chunk.iov.iov_len;
+        size_t got = chunk.result > 0 ? static_cast<size_t>(chunk.result) : 0;
+        if (got == want) continue;
+        if (chunk.result < 0 && chunk.result != -EAGAIN && chunk.result != -EINTR && !ring_failed) {
+            return false;
+        }
+
+        auto* base = static_cast<uint8_t*>(chunk.iov.iov_base) + got;
+        off_t offset = chunk.offset + static_cast<off_t>(got);
+        bool ok = opcode == IORING_OP_READV ? pread_all(fd, base, want - got, offset)
+                                            : pwrite_all(fd, base, want - got, offset);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Runs one whole-file transfer through the ring and waits for it, for callers
+// that need the result before they can go on (output writes, archive and
+// stream paths). Non-blocking reads go through read_file_async.
+bool uring_transfer_blocking(int fd, uint8_t* data, size_t size, uint8_t opcode) {
+    UringOp op;
+    add_chunks(op, data, size);
+    if (op.chunks.empty()) return true;
+
+    std::promise<void> done;
+    std::future<void> finished = done.get_future();
+    op.complete = [&done] { done.set_value(); };
+    uring->submit(op, fd, opcode);
+    finished.wait();
+    return finish_chunks(op, fd, opcode);
+}
+
+// A read that outlives its caller; freed by its own completion
+struct AsyncRead {
+    UringOp op;
+    int fd;
+    std::shared_ptr<std::vector<uint8_t>> data;
+    std::function<void(bool)> done;
+};
+
+#endif  // HEIC2WEBP_IO_URING
+
+}  // namespace
+
+bool parse_io_mode(const std::string& name, IoMode& out) {
+    if (name == "sync") {
+        out = IoMode::Sync;
+    } else if (name == "uring") {
+        out = IoMode::Uring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool init_io(IoMode mode, unsigned queue_depth) {
+    if (mode == IoMode::Sync) return true;
+#ifdef HEIC2WEBP_IO_URING
+    auto ring = std::make_unique<Uring>();
+    if (ring->init(std::max(queue_depth, 1u))) {
+        uring = std::move(ring);
+        return true;
+    }
+#else
+    (void)queue_depth;
+#endif
+    return false;
+}
+
+void shutdown_io() {
+#ifdef HEIC2WEBP_IO_URING
+    uring.reset();
+#endif
+}
+
+void set_io_depth(unsigned depth) {
+#ifdef HEIC2WEBP_IO_URING
+    if (uring) uring->set_limit(depth);
+#else
+    (void)depth;
+#endif
+}
+
+unsigned io_depth() {
+#ifdef HEIC2WEBP_IO_URING
+    if (uring) return uring->limit();
+#endif
+    return 0;
+}
+
+const char* io_backend_name() {
+#ifdef HEIC2WEBP_IO_URING
+    if (uring) return "io_uring";
+#endif
+    return "pread/pwrite";
+}
+
+bool read_file(const fs::path& path, std::vector<uint8_t>& data) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    data.resize(static_cast<size_t>(st.st_size));
+
+    bool ok;
+#ifdef HEIC2WEBP_IO_URING
+    if (uring && uring->usable()) {
+        ok = uring_transfer_blocking(fd, data.data(), data.size(), IORING_OP_READV);
+    } else
+#endif
+    {
+        ok = pread_all(fd, data.data(), data.size(), 0);
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool async_reads() {
+#ifdef HEIC2WEBP_IO_URING
+    return uring && uring->usable();
+#else
+    return false;
+#endif
+}
+
+void read_file_async(const fs::path& path, std::shared_ptr<std::vector<uint8_t>> data,
+                     std::function<void(bool)> done) {
+#ifdef HEIC2WEBP_IO_URING
+    if (async_reads()) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) {
+            if (fd >= 0) ::close(fd);
+            done(false);
+            return;
+        }
+        data->resize(static_cast<size_t>(st.st_size));
+        if (data->empty()) {
+            ::close(fd);
+            done(true);
+            return;
+        }
+
+        auto* read = new AsyncRead{{}, fd, std::move(data), std::move(done)};
+        add_chunks(read->op, read->data->data(), read->data->size());
+        // Runs on the completion thread; short reads, rare for regular files,
+        // are finished there with pread
+        read->op.complete = [read] {
+            bool ok = finish_chunks(read->op, read->fd, IORING_OP_READV);
+            ::close(read->fd);
+            std::function<void(bool)> done = std::move(read->done);
+            delete read;
+            done(ok);
+        };
+        uring->submit(read->op, fd, IORING_OP_READV);
+        return;
+    }
+#endif
+    done(read_file(path, *data));
+}
+
+bool write_file(int fd, const uint8_t* data, size_t size) {
+#ifdef HEIC2WEBP_IO_URING
+    if (uring && uring->usable()) {
+        // WRITEV only reads from the buffer
+        return uring_transfer_blocking(fd, const_cast<uint8_t*>(data), size, IORING_OP_WRITEV);
+    }
+#endif
+    return pwrite_all(fd, data, size, 0);
+}
+
+bool read_stream(int fd, std::vector<uint8_t>& data) {
+    // Redirected regular files report their size up front
+    struct stat st;
+    size_t capacity = 1 << 20;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        capacity = static_cast<size_t>(st.st_size) + 1;
+    }
+
+    data.resize(capacity);
+    size_t size = 0;
+    for (;;) {
+        if (size == data.size()) {
+            data.resize(data.size() * 2);
+        }
+        ssize_t n = ::read(fd, data.data() + size, data.size() - size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        size += static_cast<size_t>(n);
+    }
+    data.resize(size);
+    return true;
+}
+
+bool write_stream(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+/**
+ * File I/O backend: blocking pread/pwrite or batched io_uring submissions
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+enum class IoMode {
+    Sync,   // pread/pwrite on the calling worker
+    Uring,  // io_uring shared by all workers, falls back to Sync
+};
+
+bool parse_io_mode(const std::string& name, IoMode& out);
+
+// Starts the backend. Returns false when io_uring was requested but is not
+// available (old kernel, seccomp, no Linux); I/O then uses pread/pwrite.
+bool init_io(IoMode mode, unsigned queue_depth);
+void shutdown_io();
+
+// Caps io_uring submissions in flight at `depth`, at most the ring size set by
+// init_io. io_depth() returns the cap, 0 with pread/pwrite.
+void set_io_depth(unsigned depth);
+unsigned io_depth();
+const char* io_backend_name();
+
+// Reads a whole file. With io_uring the file is split into chunks that are
+// submitted in one batch and completed by the backend's completion thread.
+// Either way the call returns once the data is in; read_file_async is the
+// form that frees the caller.
+bool read_file(const fs::path& path, std::vector<uint8_t>& data);
+
+// True when read_file_async returns before the data is in, i.e. io_uring is
+// up and has not failed
+bool async_reads();
+
+// Reads a whole file into `data` without holding the caller. `done` receives
+// the result: with io_uring on the backend's completion thread, so it must
+// only hand the work on, e.g. submit a task; otherwise on the calling thread
+// before read_file_async returns.
+void read_file_async(const fs::path& path, std::shared_ptr<std::vector<uint8_t>> data,
+                     std::function<void(bool)> done);
+
+// Writes `size` bytes from the start of `fd`
+bool write_file(int fd, const uint8_t* data, size_t size);
+
+// Reads a pipe or terminal until EOF into a growing buffer
+bool read_stream(int fd, std::vector<uint8_t>& data);
+
+// Sequential write for pipes, where offsets don't apply
+bool write_stream(int fd, const uint8_t* data, size_t size);
@@ -0,0 +1,190 @@
+/**
+ * Append-only batch journal for crash-resumable runs
+ */
+
+#include "journal.h"
+
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Paths may contain any byte but NUL, so the record separators are escaped
+std::string escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+std::string unescape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' && i + 1 < s.size()) {
+            char next = s[++i];
+            out += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+std::vector<std::string> split_fields(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(unescape(line.substr(start, tab - start)));
+        if (tab == std::string::npos) break;
+        start = tab + 1;
+    }
+    return fields;
+}
+
+}  // namespace
+
+Journal::~Journal() {
+    flush();
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool Journal::open(const fs::path& path, bool resume) {
+    if (resume) {
+        load(path);
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (resume ? 0 : O_TRUNC);
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        std::cerr << "❌ Failed to open journal: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Journal::load(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return;
+    }
+
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t start = 0;
+    size_t end;
+    // Only newline-terminated records count; a crash can leave a partial last line
+    while ((end = content.find('\n', start)) != std::string::npos) {
+        std::vector<std::string> fields = split_fields(content.substr(start, end - start));
+        start = end + 1;
+
+        const std::string& kind = fields[0];
+        if (kind == "W" && fields.size() == 3 && !work_list_complete_) {
+            if (listed_.insert(fields[1]).second) {
+                work_list_.push_back({fields[1], fields[2]});
+            }
+        } else if (kind == "L") {
+            work_list_complete_ = true;
+        } else if (kind == "D" && fields.size() == 2) {
+            done_.insert(fields[1]);
+        } else if (kind == "E" && fields.size() == 2) {
+            done_.erase(fields[1]);
+        }
+    }
+
+    if (!work_list_complete_) {
+        work_list_.clear();
+    }
+}
+
+void Journal::record_work_list(const std::vector<WorkItem>& items) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& item : items) {
+            buffer_ += "W\t" + escape(item.input.string()) + "\t" + escape(item.output.string()) + "\n";
+        }
+        work_list_ = items;
+    }
+    record_work_list_end();
+}
+
+void Journal::record_work_item(const WorkItem& item) {
+    {
+        // A resumed stream reads its list again from the start
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!listed_.insert(item.input.string()).second) {
+            return;
+        }
+    }
+    append("W\t" + escape(item.input.string()) + "\t" + escape(item.output.string()) + "\n");
+}
+
+void Journal::record_work_list_end() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_ += "L\n";
+    work_list_complete_ = true;
+    flush_locked();
+}
+
+void Journal::record_result(const fs::path& input, bool ok) {
+    append(std::string(ok ? "D\t" : "E\t") + escape(input.string()) + "\n", ok);
+}
+
+void Journal::append(std::string record, bool done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    (done ? done_buffer_ : buffer_) += record;
+    buffered_records_++;
+
+    if (buffered_records_ >= kFlushRecords ||
+        std::chrono::steady_clock::now() - last_flush_ >= kFlushInterval) {
+        flush_locked();
+    }
+}
+
+void Journal::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush_locked();
+}
+
+void Journal::flush_locked() {
+    last_flush_ = std::chrono::steady_clock::now();
+    buffered_records_ = 0;
+    if (!done_buffer_.empty()) {
+        if (!barrier_ || barrier_()) {
+            buffer_ += done_buffer_;
+        }
+        done_buffer_.clear();
+    }
+    if (fd_ < 0 || buffer_.empty()) {
+        return;
+    }
+
+    // O_APPEND keeps each write at the end; the page cache is enough to survive a
+    // process crash, which is what resuming is for
+    const char* data = buffer_.data();
+    size_t size = buffer_.size();
+    while (size > 0) {
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "❌ Failed to write journal" << std::endl;
+            break;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
@@ -0,0 +1,76 @@
+/**
+ * Append-only batch journal for crash-resumable runs
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "convert.h"
+
+namespace fs = std::filesystem;
+
+// Text log, one tab separated record per line:
+//   W <input> <output>   work item, written after discovery or as streamed
+//   L                    end of the work list
+//   D <input>            converted
+//   E <input>            failed (retried on resume)
+// A torn last line from a crash is ignored when loading.
+class Journal {
+public:
+    ~Journal();
+
+    // Opens `path` for appending. With `resume` the existing records are
+    // loaded first; otherwise the file is truncated.
+    bool open(const fs::path& path, bool resume);
+
+    bool has_work_list() const { return work_list_complete_; }
+    const std::vector<WorkItem>& work_list() const { return work_list_; }
+    bool is_done(const fs::path& input) const { return done_.count(input.string()) > 0; }
+
+    void record_work_list(const std::vector<WorkItem>& items);
+
+    // Streaming form of record_work_list for lists that arrive incrementally.
+    // Items already recorded, by this run or a resumed partial one, are skipped.
+    void record_work_item(const WorkItem& item);
+    void record_work_list_end();
+    void record_result(const fs::path& input, bool ok);
+
+    // Runs before each flush that includes D records; they are only written
+    // when it returns true and are otherwise dropped, so the files are
+    // converted again on resume. Durable mode commits its outputs here, so a
+    // D record never reaches the disk ahead of its output.
+    void set_commit_barrier(std::function<bool()> barrier) { barrier_ = std::move(barrier); }
+
+    // Writes buffered records; called automatically every kFlushRecords
+    // records or kFlushInterval, and on destruction
+    void flush();
+
+private:
+    static constexpr size_t kFlushRecords = 256;
+    static constexpr std::chrono::milliseconds kFlushInterval{1000};
+
+    void load(const fs::path& path);
+    void append(std::string record, bool done = false);
+    void flush_locked();
+
+    int fd_ = -1;
+    std::mutex mutex_;
+    std::string buffer_;
+    std::string done_buffer_;  // D records, held back until the barrier passes
+    std::function<bool()> barrier_;
+    size_t buffered_records_ = 0;
+    std::chrono::steady_clock::time_point last_flush_ = std::chrono::steady_clock::now();
+
+    std::vector<WorkItem> work_list_;
+    bool work_list_complete_ = false;
+    std::unordered_set<std::string> done_;
+    std::unordered_set<std::string> listed_;  // inputs of W records, loaded or written
+};
@@ -3,27 +3,50 @@
  * Uses libheif for HEIC decoding and libwebp for WebP encoding
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
-#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <libheif/heif.h>
-#include <webp/encode.h>
 
-namespace fs = std::filesystem;
+#include "adaptive.h"
+#include "archive.h"
+#include "cancel.h"
+#include "convert.h"
+#include "decode.h"
+#include "dedup.h"
+#include "encoder.h"
+#include "file_list.h"
+#include "io_backend.h"
+#include "journal.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "options.h"
+#include "output_writer.h"
+#include "probe.h"
+#include "startup_profile.h"
+#include "trace.h"
+#include "tonemap.h"
+#include "worker_pool.h"
 
-struct Options {
-    std::string input;
-    std::string output_dir;
-    int quality = 85;
-    bool recursive = false;
-    bool verbose = false;
-};
+namespace fs = std::filesystem;
 
 void print_usage(const char* program_name) {
     std::cout << R"(
@@ -33,11 +56,63 @@ Usage:
   )" << program_name << R"( <input> [options]
 
 Arguments:
-  <input>              HEIC file or directory containing HEIC files
+  <input>              HEIC file or directory containing HEIC files,
+                       or - to read one image from stdin
 
 Options:
-  -o, --output <dir>   Output directory (default: same as input)
+  -o, --output <dir>   Output directory (default: same as input),
+                       or - to write a single image to stdout
   -q, --quality <n>    WebP quality 1-100 (default: 85)
+  --formats <list>     Output formats, comma separated: webp, jpeg, png,
+                       avif (default: webp)
+  --alpha-quality <n>  Alpha plane quality 0-100 (default: 100)
+  --alpha-filter <f>   Alpha filtering: none, fast, best (default: fast)
+  --sharp-yuv          Slower, sharper RGB→YUV conversion that keeps fine
+                       coloured edges (text, line art) crisp
+  --method <n>         WebP compression effort 0-6, faster to smaller
+                       (default: 4)
+  --degrade-queue <n>  Encode bulk files with method 0 while at least <n>
+                       bulk files are waiting (default: never)
+  --tonemap <op>       High bit-depth mapping: auto, clip, reinhard, pq, hlg
+                       (default: auto)
+  --metadata <list>    Copy metadata: none, all or any of exif,xmp,icc
+                       (default: none)
+  --animate            Encode multi-image HEIFs (bursts, sequences) as
+                       animated WebP
+  --frame-delay <ms>   Animation frame duration (default: 100)
+  --all-images         Convert every top-level image to <name>_<n>.webp
+  -j, --jobs <n>       Worker threads (default: one per CPU core), or auto
+                       to tune the count to measured throughput
+  --io <backend>       File I/O: sync (pread/pwrite) or uring (default: sync)
+  --io-depth <n>       io_uring queue depth (default: 64)
+  --durable            fsync outputs, batched into group commits
+  --sync-batch <n>     Outputs per group commit (default: 64)
+  --sync-interval <ms> Maximum time between group commits (default: 1000)
+  --files-from <file>  Read input paths from <file> ("-" for stdin), one per
+                       line or NUL separated, optionally "<input>\t<output>"
+                       then a priority (interactive, bulk) and a deadline
+                       in ms, as further tab-separated fields
+  --journal <file>     Record the work list and finished files in <file>
+  --resume             Continue the run recorded in the --journal file
+  --archive <fmt>      Read <input> as a tar or zip stream (implied by a
+                       .tar/.zip extension; needed for stdin)
+  --tar-out <file>     Write the WebPs of an archive input into a tar
+                       stream (- for stdout) instead of files
+  --ordered            Write --tar-out entries in archive order rather
+                       than as they finish
+  --dedup              Convert identical input files once and hard-link
+                       the other outputs
+  --probe <fmt>        Don't convert; write dimensions, bit depth, alpha,
+                       image and thumbnail counts as json or csv to stdout
+  --trace <file>       Write a per-file, per-thread timeline of the read,
+                       parse, decode, convert, encode and write stages as
+                       Chrome trace JSON (open in Perfetto or chrome://tracing)
+  --metrics-listen <a> Serve Prometheus metrics at /metrics on port <a> of
+                       127.0.0.1, or on unix:<path>
+  --metrics-textfile <file>
+                       Write the metrics to <file> (node-exporter textfile
+                       format) when the run ends
+  --startup-profile    Print time spent in each startup phase to stderr
   -r, --recursive      Process directories recursively
   -v, --verbose        Show detailed progress
   -h, --help           Show this help message
@@ -49,26 +124,17 @@ Examples:
 )";
 }
 
-std::string format_bytes(size_t bytes) {
-    char buf[64];
-    if (bytes < 1024) {
-        snprintf(buf, sizeof(buf), "%zu B", bytes);
-    } else if (bytes < 1024 * 1024) {
-        snprintf(buf, sizeof(buf), "%.1f KB", bytes / 1024.0);
-    } else {
-        snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
-    }
-    return buf;
-}
-
-bool is_heic_file(const fs::path& path) {
-    if (!fs::is_regular_file(path)) return false;
+bool has_heic_extension(const fs::path& path) {
     std::string ext = path.extension().string();
     // Convert to lowercase
     for (char& c : ext) c = std::tolower(c);
     return ext == ".heic" || ext == ".heif";
 }
 
+bool is_heic_file(const fs::path& path) {
+    return fs::is_regular_file(path) && has_heic_extension(path);
+}
+
 std::vector<fs::path> find_heic_files(const fs::path& dir, bool recursive) {
     std::vector<fs::path> files;
     
@@ -89,101 +155,321 @@ std::vector<fs::path> find_heic_files(const fs::path& dir, bool recursive) {
     return files;
 }
 
-fs::path get_output_path(const fs::path& input, const std::string& output_dir) {
+// With `input_root` (a recursive directory walk), the input's path below the
+// root is mirrored under `output_dir`, so equal file names in different
+// subdirectories don't overwrite each other.
+fs::path get_output_path(const fs::path& input, const std::string& output_dir,
+                         const fs::path& input_root = {}) {
     fs::path dir = output_dir.empty() ? input.parent_path() : fs::path(output_dir);
+    if (!output_dir.empty() && !input_root.empty()) {
+        fs::path relative = input.parent_path().lexically_relative(input_root);
+        if (!relative.empty() && relative != ".") {
+            dir /= relative;
+        }
+    }
     return dir / (input.stem().string() + ".webp");
 }
 
-bool convert_heic_to_webp(const fs::path& input_path, const fs::path& output_path, 
-                          const Options& opts) {
+fs::path indexed_output_path(const fs::path& output_path, int index) {
+    return output_path.parent_path() / 
+           (output_path.stem().string() + "_" + std::to_string(index) + output_path.extension().string());
+}
+
+// Converts every top-level image of `input` as its own pool task. The container
+// is parsed once and shared by the tasks; `done` runs after the last image.
+// `options` is shared with the per-image tasks, which outlive the caller. The
+// tasks keep the file's priority and deadline from `task_options`; an image
+// whose deadline passes is dropped and fails the file.
+void convert_all_images(WorkerPool& pool, const fs::path& input, const fs::path& output_path,
+                        std::shared_ptr<const Options> options, const TaskOptions& task_options,
+                        std::function<void(bool)> done) {
+    const Options& opts = *options;
     if (opts.verbose) {
-        std::cout << "📸 Decoding: " << input_path << std::endl;
+        std::cout << "📸 Decoding: " << input << std::endl;
     }
 
-    // Open HEIC file
-    heif_context* ctx = heif_context_alloc();
-    heif_error err = heif_context_read_from_file(ctx, input_path.c_str(), nullptr);
-    
-    if (err.code != heif_error_Ok) {
-        std::cerr << "❌ Failed to read HEIC: " << err.message << std::endl;
-        heif_context_free(ctx);
-        return false;
+    HeifContextPtr ctx = open_heic(input);
+    if (!ctx) {
+        done(false);
+        return;
     }
 
-    // Get primary image handle
-    heif_image_handle* handle;
-    err = heif_context_get_primary_image_handle(ctx, &handle);
-    
-    if (err.code != heif_error_Ok) {
-        std::cerr << "❌ Failed to get image handle: " << err.message << std::endl;
-        heif_context_free(ctx);
-        return false;
+    int count = heif_context_get_number_of_top_level_images(ctx.get());
+    std::vector<heif_item_id> ids(count);
+    heif_context_get_list_of_top_level_image_IDs(ctx.get(), ids.data(), count);
+
+    if (count <= 1) {
+        done(count == 1 && convert_image(ctx.get(), ids[0], output_path, opts));
+        return;
     }
 
-    // Decode to RGB
-    heif_image* img;
-    err = heif_decode_image(handle, &img, heif_colorspace_RGB, heif_chroma_interleaved_RGB, nullptr);
-    
-    if (err.code != heif_error_Ok) {
-        std::cerr << "❌ Failed to decode image: " << err.message << std::endl;
-        heif_image_handle_release(handle);
-        heif_context_free(ctx);
-        return false;
+    if (opts.verbose) {
+        std::cout << "   Images: " << count << std::endl;
     }
 
-    int width = heif_image_get_width(img, heif_channel_interleaved);
-    int height = heif_image_get_height(img, heif_channel_interleaved);
-    
+    struct Pending {
+        std::atomic<int> remaining;
+        std::atomic<bool> failed{false};
+    };
+    auto pending = std::make_shared<Pending>();
+    pending->remaining = count;
+
+    for (int i = 0; i < count; i++) {
+        fs::path image_output = indexed_output_path(output_path, i + 1);
+        heif_item_id id = ids[i];
+        TaskOptions image_options;
+        image_options.priority = task_options.priority;
+        image_options.deadline = task_options.deadline;
+        image_options.expired = [image_output, pending, done] {
+            std::cerr << ("⏰ Deadline passed, dropped: " + image_output.filename().string() + "\n");
+            pending->failed = true;
+            if (--pending->remaining == 0) {
+                done(false);
+            }
+        };
+        pool.submit([ctx, id, image_output, options, pending, done] {
+            if (!convert_image(ctx.get(), id, image_output, *options)) {
+                pending->failed = true;
+            }
+            if (--pending->remaining == 0) {
+                done(!pending->failed);
+            }
+        }, std::move(image_options));
+    }
+}
+
+// Converts one image, from stdin or a file, to stdout; parse_args rejects
+// stdin input with any other output. The whole path stays in memory: no temp
+// files, no re-reads.
+int convert_stream(const Options& opts) {
+    // Progress and results must not mix with the WebP bytes
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    fs::path input_label = opts.input == "-" ? fs::path("stdin") : fs::path(opts.input);
+    TraceFile trace_file(input_label);
+    bool read_ok;
+    {
+        TraceSpan span(TraceStage::Read);
+        read_ok = opts.input == "-" ? read_stream(STDIN_FILENO, *data) 
+                                    : read_file(opts.input, *data);
+    }
+    if (!read_ok) {
+        std::cerr << "❌ Failed to read HEIC: " << input_label << std::endl;
+        return 1;
+    }
+    startup_mark("read");
+
     if (opts.verbose) {
-        std::cout << "   Dimensions: " << width << "x" << height << std::endl;
-        std::cout << "💾 Encoding WebP: " << output_path << std::endl;
+        std::cout << "📸 Decoding: " << input_label << " (" << format_bytes(data->size()) << ")" 
+                  << std::endl;
     }
 
-    int stride;
-    const uint8_t* rgb_data = heif_image_get_plane_readonly(img, heif_channel_interleaved, &stride);
+    HeifContextPtr ctx = open_heic_buffer(data);
+    if (!ctx) {
+        return 1;
+    }
 
-    // Encode to WebP
-    uint8_t* webp_data = nullptr;
-    size_t webp_size = WebPEncodeRGB(rgb_data, width, height, stride, 
-                                      static_cast<float>(opts.quality), &webp_data);
+    fs::path output_path("stdout");
+    WebPData webp;
+    WebPDataInit(&webp);
+    bool ok = encode_heic(ctx.get(), output_path, opts, &webp);
+    ctx.reset();
+    startup_mark("decode+encode");
 
-    if (webp_size == 0) {
-        std::cerr << "❌ Failed to encode WebP" << std::endl;
-        heif_image_release(img);
-        heif_image_handle_release(handle);
-        heif_context_free(ctx);
-        return false;
+    if (ok) {
+        TraceSpan span(TraceStage::Write);
+        ok = write_stream(STDOUT_FILENO, webp.bytes, webp.size);
+        if (ok) {
+            count_output_bytes(webp.size);
+        } else {
+            std::cerr << "❌ Failed to write output: " << output_path << std::endl;
+        }
+        startup_mark("write");
     }
 
-    // Write output file
-    std::ofstream out(output_path, std::ios::binary);
-    if (!out) {
-        std::cerr << "❌ Failed to create output file: " << output_path << std::endl;
-        WebPFree(webp_data);
-        heif_image_release(img);
-        heif_image_handle_release(handle);
-        heif_context_free(ctx);
-        return false;
+    if (ok && opts.verbose) {
+        std::cout << "✅ " << input_label.filename().string() << " → " 
+                  << output_path.filename().string() << " (" << format_bytes(webp.size) << ")" 
+                  << std::endl;
     }
-    
-    out.write(reinterpret_cast<char*>(webp_data), webp_size);
-    out.close();
 
-    if (opts.verbose) {
-        size_t input_size = fs::file_size(input_path);
-        double ratio = (1.0 - static_cast<double>(webp_size) / input_size) * 100.0;
-        std::cout << "   Size: " << format_bytes(input_size) << " → " 
-                  << format_bytes(webp_size) << " (" << std::fixed 
-                  << std::setprecision(1) << ratio << "% smaller)" << std::endl;
+    count_file(ok);
+    WebPDataClear(&webp);
+    return ok ? 0 : 1;
+}
+
+// Converts the HEIC members of a tar or ZIP stream without extracting it. Members
+// are handed to the pool as in-memory buffers while the archive is still being
+// read; results go to a tar stream or to files under the output directory.
+int convert_archive(const Options& opts) {
+    bool from_stdin = opts.input == "-";
+    bool to_stdout = opts.tar_out == "-";
+    ArchiveFormat format = opts.archive != ArchiveFormat::None ? opts.archive 
+                                                                : archive_format_for(opts.input);
+
+    if (to_stdout) {
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
 
-    // Cleanup
-    WebPFree(webp_data);
-    heif_image_release(img);
-    heif_image_handle_release(handle);
-    heif_context_free(ctx);
+    int in_fd = from_stdin ? STDIN_FILENO : ::open(opts.input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        std::cerr << "❌ Failed to open archive: " << opts.input << std::endl;
+        return 1;
+    }
 
-    return true;
+    int out_fd = -1;
+    if (to_stdout) {
+        out_fd = STDOUT_FILENO;
+    } else if (!opts.tar_out.empty()) {
+        out_fd = ::open(opts.tar_out.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0) {
+            std::cerr << "❌ Failed to create tar output: " << opts.tar_out << std::endl;
+            if (!from_stdin) ::close(in_fd);
+            return 1;
+        }
+    }
+
+    fs::path output_dir = opts.output_dir;
+    if (out_fd < 0 && output_dir.empty() && !from_stdin) {
+        output_dir = fs::absolute(opts.input).parent_path();
+    }
+
+    if (!init_io(opts.io_mode, opts.io_depth)) {
+        std::cerr << "⚠️  io_uring unavailable, using " << io_backend_name() << std::endl;
+    }
+    if (opts.durable) {
+        configure_durable_outputs(static_cast<size_t>(opts.sync_batch), opts.sync_interval);
+    }
+
+    WorkerPool pool(opts.jobs, warm_up_decoder);
+    std::atomic<int> success_count{0};
+    std::atomic<int> error_count{0};
+
+    // Members are held in memory until converted, and with --ordered their
+    // results until written, so cap how many wait in the pool or the tar writer
+    size_t max_in_flight = pool.size() * 2;
+    size_t in_flight = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+    auto release_slot = [&] {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight--;
+        }
+        cv.notify_one();
+    };
+
+    std::unique_ptr<TarWriter> tar;
+    if (out_fd >= 0) {
+        tar = std::make_unique<TarWriter>(out_fd, opts.ordered, release_slot);
+    }
+
+    size_t sequence = 0;
+    size_t unstarted = 0;
+    // Members whose outputs would land on the same name, e.g. a.heic and
+    // a.HEIF, are failed rather than overwriting each other
+    std::set<std::string> output_names;
+    bool read_ok = read_archive(in_fd, format, [&](ArchiveMember member) {
+        if (stop_requested()) {
+            unstarted += has_heic_extension(member.name);
+            return;
+        }
+        if (!has_heic_extension(member.name)) {
+            if (opts.verbose) {
+                std::cout << "   Skipping " << member.name << std::endl;
+            }
+            return;
+        }
+        fs::path name = fs::path(member.name).replace_extension(".webp");
+        if (!output_names.insert(name.generic_string()).second) {
+            count_file(false);
+            error_count++;
+            std::cerr << "❌ Output name collision, skipping: " << member.name << " → " 
+                      << name.generic_string() << " is already taken" << std::endl;
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return in_flight < max_in_flight; });
+            in_flight++;
+        }
+
+        pool.submit([&, member = std::move(member), name = std::move(name), seq = sequence++] {
+            TraceFile trace_file(member.name);
+            fs::path output_path = output_dir / name;
+            if (opts.verbose) {
+                std::cout << "📸 Decoding: " << member.name << " (" 
+                          << format_bytes(member.data->size()) << ")" << std::endl;
+            }
+
+            WebPData webp;
+            WebPDataInit(&webp);
+            HeifContextPtr ctx = open_heic_buffer(member.data);
+            bool ok = ctx && encode_heic(ctx.get(), name, opts, &webp);
+            ctx.reset();
+
+            if (ok && tar) {
+                TraceSpan span(TraceStage::Write);
+                ok = tar->add(seq, name.generic_string(), webp.bytes, webp.size);
+                if (ok) {
+                    count_output_bytes(webp.size);
+                }
+            } else if (ok) {
+                ok = write_webp(output_path, webp);
+            } else if (tar) {
+                tar->skip(seq);
+            }
+            WebPDataClear(&webp);
+
+            if (ok) {
+                count_file(true);
+                success_count++;
+                std::cout << ("✅ " + member.name + " → " + name.generic_string() + "\n") << std::flush;
+            } else if (!cancelled()) {
+                count_file(false);
+                error_count++;
+                std::cerr << ("❌ Failed: " + member.name + "\n");
+            }
+
+            // The tar writer releases the slot once the entry is written out
+            if (!tar) {
+                release_slot();
+            }
+        });
+    });
+
+    pool.wait();
+
+    if (!read_ok) {
+        std::cerr << "❌ Malformed or unsupported archive: " << (from_stdin ? "stdin" : opts.input) 
+                  << std::endl;
+        error_count++;
+    }
+    if (tar && !tar->finish()) {
+        std::cerr << "❌ Failed to write tar output: " << opts.tar_out << std::endl;
+        error_count++;
+    }
+    if (!flush_outputs()) {
+        error_count++;
+    }
+    shutdown_io();
+
+    if (!from_stdin) ::close(in_fd);
+    if (out_fd >= 0 && !to_stdout && ::close(out_fd) != 0) {
+        error_count++;
+    }
+
+    if (unstarted > 0) {
+        std::cout << "\n⏸️  Left " << unstarted << " archive member(s) unstarted";
+    }
+    std::cout << "\n📊 Converted: " << success_count << "/" << sequence << " archive members" 
+              << std::endl;
+    if (cancelled()) {
+        return 130;
+    }
+    return error_count > 0 ? 1 : 0;
 }
 
 Options parse_args(int argc, char* argv[]) {
@@ -213,80 +499,759 @@ Options parse_args(int argc, char* argv[]) {
                 std::cerr << "❌ Missing argument for " << arg << std::endl;
                 exit(1);
             }
+        } else if (arg == "--alpha-quality") {
+            if (i + 1 < argc) {
+                opts.alpha_quality = std::stoi(argv[++i]);
+                if (opts.alpha_quality < 0 || opts.alpha_quality > 100) {
+                    std::cerr << "❌ Alpha quality must be between 0 and 100" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--trace") {
+            if (i + 1 < argc) {
+                opts.trace = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--metrics-listen") {
+            if (i + 1 < argc) {
+                opts.metrics_listen = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--metrics-textfile") {
+            if (i + 1 < argc) {
+                opts.metrics_textfile = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--startup-profile") {
+            opts.startup_profile = true;
+        } else if (arg == "--method") {
+            if (i + 1 < argc) {
+                opts.method = std::stoi(argv[++i]);
+                if (opts.method < 0 || opts.method > 6) {
+                    std::cerr << "❌ Method must be between 0 and 6" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--degrade-queue") {
+            if (i + 1 < argc) {
+                opts.degrade_queue = std::stoul(argv[++i]);
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--formats") {
+            if (i + 1 < argc) {
+                if (!parse_output_formats(argv[++i], opts.formats)) {
+                    std::cerr << "❌ Unknown output format in: " << argv[i] 
+                              << " (use webp, jpeg, png, avif)" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--sharp-yuv") {
+            opts.sharp_yuv = true;
+        } else if (arg == "--alpha-filter") {
+            if (i + 1 < argc) {
+                std::string filter = argv[++i];
+                if (filter == "none") {
+                    opts.alpha_filter = 0;
+                } else if (filter == "fast") {
+                    opts.alpha_filter = 1;
+                } else if (filter == "best") {
+                    opts.alpha_filter = 2;
+                } else {
+                    std::cerr << "❌ Alpha filter must be none, fast or best" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--tonemap") {
+            if (i + 1 < argc) {
+                if (!parse_tone_map(argv[++i], opts.tone_map)) {
+                    std::cerr << "❌ Tone map must be auto, clip, reinhard, pq or hlg" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--metadata") {
+            if (i + 1 < argc) {
+                if (!parse_metadata_kinds(argv[++i], opts.metadata)) {
+                    std::cerr << "❌ Metadata must be none, all or a list of exif,xmp,icc" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--animate") {
+            opts.animate = true;
+        } else if (arg == "--frame-delay") {
+            if (i + 1 < argc) {
+                opts.frame_delay = std::stoi(argv[++i]);
+                if (opts.frame_delay < 1) {
+                    std::cerr << "❌ Frame delay must be at least 1 ms" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--all-images") {
+            opts.all_images = true;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (i + 1 < argc && std::string(argv[i + 1]) == "auto") {
+                opts.adaptive_jobs = true;
+                i++;
+            } else if (i + 1 < argc) {
+                int jobs = std::stoi(argv[++i]);
+                if (jobs < 1) {
+                    std::cerr << "❌ Jobs must be at least 1" << std::endl;
+                    exit(1);
+                }
+                opts.jobs = static_cast<unsigned>(jobs);
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--io") {
+            if (i + 1 < argc) {
+                if (!parse_io_mode(argv[++i], opts.io_mode)) {
+                    std::cerr << "❌ I/O backend must be sync or uring" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--io-depth") {
+            if (i + 1 < argc) {
+                int depth = std::stoi(argv[++i]);
+                if (depth < 1 || depth > 4096) {
+                    std::cerr << "❌ I/O depth must be between 1 and 4096" << std::endl;
+                    exit(1);
+                }
+                opts.io_depth = static_cast<unsigned>(depth);
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--durable") {
+            opts.durable = true;
+        } else if (arg == "--sync-batch") {
+            if (i + 1 < argc) {
+                opts.sync_batch = std::stoi(argv[++i]);
+                if (opts.sync_batch < 1) {
+                    std::cerr << "❌ Sync batch must be at least 1" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--sync-interval") {
+            if (i + 1 < argc) {
+                opts.sync_interval = std::stoi(argv[++i]);
+                if (opts.sync_interval < 1) {
+                    std::cerr << "❌ Sync interval must be at least 1 ms" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--files-from") {
+            if (i + 1 < argc) {
+                opts.files_from = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--journal") {
+            if (i + 1 < argc) {
+                opts.journal = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--resume") {
+            opts.resume = true;
+        } else if (arg == "--archive") {
+            if (i + 1 < argc) {
+                if (!parse_archive_format(argv[++i], opts.archive)) {
+                    std::cerr << "❌ Archive format must be tar or zip" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--tar-out") {
+            if (i + 1 < argc) {
+                opts.tar_out = argv[++i];
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
+        } else if (arg == "--ordered") {
+            opts.ordered = true;
+        } else if (arg == "--dedup") {
+            opts.dedup = true;
+        } else if (arg == "--probe") {
+            if (i + 1 < argc) {
+                if (!parse_probe_format(argv[++i], opts.probe)) {
+                    std::cerr << "❌ Probe format must be json or csv" << std::endl;
+                    exit(1);
+                }
+            } else {
+                std::cerr << "❌ Missing argument for " << arg << std::endl;
+                exit(1);
+            }
         } else if (arg == "-r" || arg == "--recursive") {
             opts.recursive = true;
         } else if (arg == "-v" || arg == "--verbose") {
             opts.verbose = true;
-        } else if (arg[0] == '-') {
+        } else if (arg[0] == '-' && arg != "-") {
             std::cerr << "❌ Unknown option: " << arg << std::endl;
             exit(1);
         } else {
             opts.input = arg;
         }
     }
+
+    if (!opts.files_from.empty() && !opts.input.empty()) {
+        std::cerr << "❌ --files-from cannot be combined with <input>" << std::endl;
+        exit(1);
+    }
+
+    bool archive_input = opts.archive != ArchiveFormat::None || 
+                         archive_format_for(opts.input) != ArchiveFormat::None;
+    if (archive_input) {
+        if (opts.input.empty()) {
+            std::cerr << "❌ --archive needs an <input> archive or - for stdin" << std::endl;
+            exit(1);
+        }
+        if (opts.output_dir == "-" || !opts.journal.empty() || opts.all_images) {
+            std::cerr << "❌ Archive input cannot be combined with -o -, --journal or --all-images" 
+                      << std::endl;
+            exit(1);
+        }
+        if (opts.input == "-" && opts.output_dir.empty() && opts.tar_out.empty()) {
+            std::cerr << "❌ Archive from stdin needs -o <dir> or --tar-out" << std::endl;
+            exit(1);
+        }
+    } else if (!opts.tar_out.empty() || opts.ordered) {
+        std::cerr << "❌ --tar-out and --ordered need an archive input" << std::endl;
+        exit(1);
+    }
+
+    if (opts.input == "-" && !archive_input && !opts.output_dir.empty() && opts.output_dir != "-") {
+        std::cerr << "❌ Input from stdin is written to stdout (-o -)" << std::endl;
+        exit(1);
+    }
+
+    if (opts.output_dir == "-" && (!opts.files_from.empty() || !opts.journal.empty() ||
+                                   opts.all_images)) {
+        std::cerr << "❌ -o - writes a single image and needs a single input" << std::endl;
+        exit(1);
+    }
+
+    if (opts.resume && opts.journal.empty()) {
+        std::cerr << "❌ --resume requires --journal" << std::endl;
+        exit(1);
+    }
+
+    if (opts.animate && opts.all_images) {
+        std::cerr << "❌ --animate and --all-images cannot be combined" << std::endl;
+        exit(1);
+    }
+
+    if (opts.probe != ProbeFormat::None && (archive_input || opts.input == "-" || 
+                                            !opts.output_dir.empty() || !opts.journal.empty() || 
+                                            opts.dedup)) {
+        std::cerr << "❌ --probe reads files or --files-from lists and writes to stdout only" 
+                  << std::endl;
+        exit(1);
+    }
+
+    if (opts.dedup && (opts.all_images || archive_input)) {
+        std::cerr << "❌ --dedup cannot be combined with --all-images or archive input" << std::endl;
+        exit(1);
+    }
     
     return opts;
 }
 
 int main(int argc, char* argv[]) {
+    startup_mark("main");
     if (argc < 2) {
         print_usage(argv[0]);
         return 1;
     }
 
     Options opts = parse_args(argc, argv);
-    
-    if (opts.input.empty()) {
-        print_usage(argv[0]);
+    startup_mark("options");
+
+    // Before any thread starts, so they all leave the signals to the watcher
+    if (!install_stop_handlers()) {
+        std::cerr << "⚠️  Signal handling unavailable, Ctrl-C stops immediately" << std::endl;
+    }
+    if (opts.startup_profile) {
+        std::atexit(print_startup_profile);
+    }
+    if (!opts.trace.empty() && !start_tracing(opts.trace)) {
+        return 1;
+    }
+    if ((!opts.metrics_listen.empty() || !opts.metrics_textfile.empty()) &&
+        !start_metrics(opts.metrics_listen, opts.metrics_textfile)) {
         return 1;
     }
 
-    fs::path input_path = fs::absolute(opts.input);
-    
-    if (!fs::exists(input_path)) {
-        std::cerr << "❌ Input not found: " << input_path << std::endl;
+    if (!init_decoder()) {
         return 1;
     }
+    startup_mark("libheif init");
 
-    // Create output directory if specified
-    if (!opts.output_dir.empty()) {
-        fs::create_directories(opts.output_dir);
+    for (OutputFormat format : opts.formats) {
+        if (!encoder_available(format)) {
+            std::cerr << "❌ No " << encoder_for(format).name << " encoder in this libheif build" 
+                      << std::endl;
+            return 1;
+        }
     }
 
-    std::vector<fs::path> files;
+    // Archive members and streams map to exactly one output each
+    bool archive = opts.archive != ArchiveFormat::None || 
+                   archive_format_for(opts.input) != ArchiveFormat::None;
+    bool stream = opts.input == "-" || opts.output_dir == "-";
+    if ((archive || stream) && 
+        !(opts.formats.size() == 1 && opts.formats[0] == OutputFormat::WebP)) {
+        std::cerr << "❌ --formats applies to files and directories, not archives or streams" 
+                  << std::endl;
+        return 1;
+    }
+
+    if (archive) {
+        return convert_archive(opts);
+    }
+
+    if (stream) {
+        return convert_stream(opts);
+    }
     
-    if (fs::is_directory(input_path)) {
-        files = find_heic_files(input_path, opts.recursive);
-        if (files.empty()) {
-            std::cout << "📭 No HEIC files found" << std::endl;
-            return 0;
+    if (opts.input.empty() && opts.files_from.empty() && !opts.resume) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Probe records own stdout; progress goes to stderr
+    std::unique_ptr<ProbeWriter> probe;
+    if (opts.probe != ProbeFormat::None) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+        probe = std::make_unique<ProbeWriter>(STDOUT_FILENO, opts.probe);
+    }
+
+    Journal journal;
+    bool journaling = !opts.journal.empty();
+    if (journaling && !journal.open(opts.journal, opts.resume)) {
+        return 1;
+    }
+
+    // With --files-from, items are streamed into the pool while the list is read.
+    // --dedup has to see the whole list first.
+    bool streaming = !opts.files_from.empty() && !(journaling && journal.has_work_list()) && 
+                     !opts.dedup;
+    std::vector<WorkItem> items;
+
+    if (journaling && journal.has_work_list()) {
+        // The journal already holds the discovered files; skip the tree walk
+        items = journal.work_list();
+        std::cout << "📒 Resuming " << items.size() << " file(s) from " << opts.journal << std::endl;
+    } else if (!opts.files_from.empty()) {
+        if (!streaming) {
+            bool listed = read_file_list(opts.files_from, [&](WorkItem item) {
+                if (item.output.empty()) {
+                    item.output = get_output_path(item.input, opts.output_dir);
+                }
+                items.push_back(std::move(item));
+            });
+            if (!listed) {
+                return 1;
+            }
+            if (journaling) {
+                journal.record_work_list(items);
+            }
         }
-        std::cout << "📂 Found " << files.size() << " HEIC file(s)" << std::endl;
     } else {
-        files.push_back(input_path);
-    }
+        if (opts.input.empty()) {
+            std::cerr << "❌ Journal has no work list to resume, pass <input>" << std::endl;
+            return 1;
+        }
 
-    int success_count = 0;
-    int error_count = 0;
+        fs::path input_path = fs::absolute(opts.input);
+        
+        if (!fs::exists(input_path)) {
+            std::cerr << "❌ Input not found: " << input_path << std::endl;
+            return 1;
+        }
 
-    for (const auto& file : files) {
-        fs::path output_path = get_output_path(file, opts.output_dir);
+        std::vector<fs::path> files;
         
-        if (convert_heic_to_webp(file, output_path, opts)) {
+        if (fs::is_directory(input_path)) {
+            files = find_heic_files(input_path, opts.recursive);
+            if (files.empty()) {
+                std::cout << "📭 No HEIC files found" << std::endl;
+                return 0;
+            }
+            std::cout << "📂 Found " << files.size() << " HEIC file(s)" << std::endl;
+        } else {
+            files.push_back(input_path);
+        }
+
+        fs::path input_root = opts.recursive && fs::is_directory(input_path) ? input_path : fs::path();
+        items.reserve(files.size());
+        for (const auto& file : files) {
+            items.push_back({file, get_output_path(file, opts.output_dir, input_root)});
+        }
+        if (journaling) {
+            journal.record_work_list(items);
+        }
+    }
+
+    startup_mark("discovery");
+
+    std::atomic<int> success_count{0};
+    std::atomic<int> error_count{0};
+    std::atomic<size_t> unstarted{0};    // dropped by a drain or cancel before starting
+    std::atomic<size_t> interrupted{0};  // abandoned part way by a cancel
+
+    // Result lines are built as one string so parallel workers don't interleave
+    // them. `reason` adds to the failure line, e.g. for a file never converted.
+    auto report = [&](const fs::path& file, const fs::path& output_path, bool ok,
+                      const std::string& reason = std::string()) {
+        // Neither converted nor failed; no journal record, so --resume retries it
+        if (!ok && cancelled()) {
+            interrupted++;
+            return;
+        }
+        count_file(ok);
+        if (ok) {
             success_count++;
             if (opts.verbose) {
                 std::cout << "✅ Done\n" << std::endl;
             } else {
-                std::cout << "✅ " << file.filename().string() << " → " 
-                          << output_path.filename().string() << std::endl;
+                std::cout << ("✅ " + file.filename().string() + " → " + 
+                              output_path.filename().string() + "\n") << std::flush;
             }
         } else {
             error_count++;
-            std::cerr << "❌ Failed: " << file.filename().string() << std::endl;
+            std::cerr << ("❌ Failed: " + file.filename().string() + 
+                          (reason.empty() ? "" : " (" + reason + ")") + "\n");
+        }
+        if (journaling) {
+            journal.record_result(file, ok);
+        }
+    };
+
+    if (!init_io(opts.io_mode, opts.io_depth)) {
+        std::cerr << "⚠️  io_uring unavailable, using " << io_backend_name() << std::endl;
+    } else if (opts.verbose) {
+        std::cout << "⚙️  I/O backend: " << io_backend_name() << std::endl;
+    }
+
+    if (opts.durable) {
+        configure_durable_outputs(static_cast<size_t>(opts.sync_batch), opts.sync_interval);
+        // A file only counts as done in the journal once its output is committed
+        journal.set_commit_barrier(commit_outputs);
+    }
+    startup_mark("io init");
+
+    // Create output directory if specified, plus any mirrored subdirectories
+    if (!opts.output_dir.empty()) {
+        ensure_output_dir(opts.output_dir);
+    }
+    if (!items.empty() && !probe) {
+        std::vector<fs::path> outputs;
+        outputs.reserve(items.size());
+        for (const auto& item : items) {
+            outputs.push_back(item.output);
+        }
+        ensure_output_dirs(outputs);
+    }
+
+    // One image needs one worker; starting and warming up a thread per core
+    // would only add to the latency of single-file invocations. Probing never
+    // decodes, so its workers skip the warm-up too.
+    bool single = !streaming && items.size() == 1 && !opts.all_images;
+    bool warm_up = !probe && !single;
+    // -j auto may go up to two workers per core when they keep paying off,
+    // e.g. while workers wait on a slow disk
+    bool adaptive = opts.adaptive_jobs && !single && !probe;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(single ? 1 : adaptive ? 2 * cores : opts.jobs,
+                    warm_up ? warm_up_decoder : std::function<void()>());
+    std::unique_ptr<ConcurrencyController> controller;
+    if (adaptive) {
+        controller = std::make_unique<ConcurrencyController>(pool, cores, opts.io_depth);
+    }
+    startup_mark("workers");
+
+    size_t queued = 0;
+    size_t skipped = 0;
+    std::atomic<size_t> expired_count{0};
+    std::atomic<size_t> degraded_count{0};
+    std::atomic<size_t> prefetched{0};
+    auto submit = [&](const WorkItem& item) {
+        if (journaling && journal.is_done(item.input)) {
+            skipped++;
+            return;
+        }
+        if (stop_requested()) {
+            unstarted++;
+            return;
+        }
+        queued++;
+
+        if (probe) {
+            pool.submit([&, file = item.input] {
+                if (stop_requested()) {
+                    unstarted++;
+                    return;
+                }
+                ProbeInfo info;
+                if (probe_heic(file, info)) {
+                    success_count++;
+                } else {
+                    error_count++;
+                    std::cerr << ("❌ Failed: " + file.string() + ": " + info.error + "\n");
+                }
+                probe->add(info);
+            });
+            return;
+        }
+
+        TaskOptions task_options;
+        task_options.priority = item.priority;
+        task_options.deadline = item.deadline;
+        task_options.expired = [&, file = item.input, output_path = item.output] {
+            expired_count++;
+            report(file, output_path, false, "deadline passed, dropped");
+        };
+
+        TaskOptions image_options{item.priority, item.deadline, nullptr};
+        pool.submit([&, file = item.input, output_path = item.output, priority = item.priority,
+                     image_options = std::move(image_options)] {
+            if (stop_requested()) {
+                unstarted++;
+                return;
+            }
+
+            // A long bulk backlog trades compression for throughput. The
+            // options may be used by --all-images tasks after this one returns,
+            // so a degraded copy is reference counted; `opts` outlives the pool
+            // and is shared without ownership.
+            std::shared_ptr<const Options> task_opts(std::shared_ptr<void>(), &opts);
+            if (priority == Priority::Bulk && opts.degrade_queue > 0 && 
+                pool.queued(Priority::Bulk) >= opts.degrade_queue) {
+                auto degraded = std::make_shared<Options>(opts);
+                degraded->method = 0;
+                task_opts = std::move(degraded);
+                degraded_count++;
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            auto done = [&report, &controller, file, output_path, started](bool ok) {
+                if (controller) {
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+                    controller->record_file(elapsed.count());
+                }
+                report(file, output_path, ok);
+            };
+            if (opts.all_images) {
+                convert_all_images(pool, file, output_path, task_opts, image_options, done);
+                return;
+            }
+
+            // With io_uring the worker hands the read to the ring and moves
+            // on; the conversion comes back as a continuation, ahead of files
+            // not yet started. Reads in flight are capped at one per worker so
+            // prefetched inputs don't pile up in memory.
+            if (async_reads()) {
+                if (prefetched.fetch_add(1) < pool.size()) {
+                    auto data = std::make_shared<std::vector<uint8_t>>();
+                    pool.hold();
+                    read_file_async(file, data, [&, file, output_path, task_opts, data, done,
+                                                 priority](bool read_ok) {
+                        TaskOptions continuation;
+                        continuation.priority = priority;
+                        continuation.continuation = true;
+                        pool.submit([&, file, output_path, task_opts, data, done, read_ok] {
+                            prefetched--;
+                            if (!read_ok) {
+                                std::cerr << ("❌ Failed to read HEIC: " + file.string() + "\n");
+                            }
+                            done(read_ok && convert_heic_data_to_webp(file, data, output_path, *task_opts));
+                        }, std::move(continuation));
+                        pool.release();
+                    });
+                    return;
+                }
+                prefetched--;
+            }
+            done(convert_heic_to_webp(file, output_path, *task_opts));
+        }, std::move(task_options));
+    };
+
+    std::atomic<size_t> dedup_files{0};
+    std::atomic<uint64_t> dedup_bytes{0};
+    std::atomic<uint64_t> dedup_cpu_us{0};
+
+    // Each group is converted once; the duplicates' outputs become hard links
+    auto submit_group = [&](DedupGroup group) {
+        queued += 1 + group.duplicates.size();
+
+        pool.submit([&, group = std::move(group)] {
+            if (stop_requested()) {
+                unstarted += 1 + group.duplicates.size();
+                return;
+            }
+
+            std::vector<fs::path> links;
+            for (const auto& dup : group.duplicates) {
+                links.push_back(dup.output);
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            double cpu_start = thread_cpu_seconds();
+            bool ok = group.data
+                ? convert_heic_data_to_webp(group.primary.input, group.data,
+                                            group.primary.output, opts, links)
+                : convert_heic_to_webp(group.primary.input, group.primary.output, opts, links);
+            double cpu = thread_cpu_seconds() - cpu_start;
+            if (controller) {
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+                controller->record_file(elapsed.count());
+            }
+
+            report(group.primary.input, group.primary.output, ok);
+            for (const auto& dup : group.duplicates) {
+                report(dup.input, dup.output, ok);
+            }
+            if (ok && !group.duplicates.empty()) {
+                size_t copies = group.duplicates.size();
+                dedup_files += copies;
+                dedup_bytes += group.size * copies;
+                dedup_cpu_us += static_cast<uint64_t>(cpu * copies * 1e6);
+            }
+        });
+    };
+
+    if (opts.dedup) {
+        std::vector<WorkItem> pending;
+        for (const auto& item : items) {
+            if (journaling && journal.is_done(item.input)) {
+                skipped++;
+            } else {
+                pending.push_back(item);
+            }
+        }
+
+        std::vector<DedupGroup> groups = group_duplicates(pending, pool);
+        if (opts.verbose) {
+            std::cout << "♻️  " << groups.size() << " distinct of " << pending.size() 
+                      << " file(s)" << std::endl;
+        }
+        for (auto& group : groups) {
+            submit_group(std::move(group));
+        }
+    } else if (streaming) {
+        bool listed = read_file_list(opts.files_from, [&](WorkItem item) {
+            if (item.output.empty()) {
+                item.output = get_output_path(item.input, opts.output_dir);
+            }
+            if (journaling) {
+                journal.record_work_item(item);
+            }
+            submit(item);
+        });
+        if (!listed) {
+            error_count++;
+        } else if (journaling) {
+            journal.record_work_list_end();
+        }
+    } else {
+        for (const auto& item : items) {
+            submit(item);
+        }
+    }
+
+    pool.wait();
+    size_t adaptive_limit = controller ? controller->limit() : 0;
+    size_t adaptive_changes = controller ? controller->changes() : 0;
+    controller.reset();
+    startup_mark("convert");
+
+    if (!flush_outputs()) {
+        error_count++;
+    }
+    shutdown_io();
+    journal.flush();
+
+    if (probe) {
+        if (!probe->finish()) {
+            std::cerr << "❌ Failed to write probe output" << std::endl;
+            error_count++;
         }
+        std::cout << "\n📊 Probed: " << success_count << "/" << queued << " files" << std::endl;
+        return error_count > 0 ? 1 : 0;
     }
 
-    std::cout << "\n📊 Converted: " << success_count << "/" << files.size() << " files" << std::endl;
+    if (skipped > 0) {
+        std::cout << "\n⏭️  Skipped " << skipped << " file(s) already converted";
+    }
+    if (interrupted > 0) {
+        std::cout << "\n🛑 Abandoned " << interrupted << " file(s) in progress";
+    }
+    if (unstarted > 0) {
+        std::cout << "\n⏸️  Left " << unstarted << " file(s) unstarted" 
+                  << (journaling ? ", --resume picks them up" : "");
+    }
+    if (expired_count > 0) {
+        std::cout << "\n⏰ Dropped " << expired_count << " file(s) past their deadline";
+    }
+    if (adaptive) {
+        std::cout << "\n🎛️  Finished with " << adaptive_limit << " of " << pool.size() 
+                  << " worker(s) after " << adaptive_changes << " adjustment(s)";
+    }
+    if (degraded_count > 0) {
+        std::cout << "\n🐇 Encoded " << degraded_count << " bulk file(s) with method 0 to drain the queue";
+    }
+    if (dedup_files > 0) {
+        std::cout << "\n♻️  Deduplicated " << dedup_files << " file(s): " 
+                  << format_bytes(dedup_bytes) << " not decoded, " << std::fixed 
+                  << std::setprecision(1) << dedup_cpu_us / 1e6 << " s CPU saved";
+    }
+    std::cout << "\n📊 Converted: " << success_count << "/" << queued << " files" << std::endl;
     
+    if (cancelled()) {
+        return 130;
+    }
     return error_count > 0 ? 1 : 0;
 }
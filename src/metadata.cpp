@@ -0,0 +1,174 @@
+/**
+ * EXIF/XMP/ICC passthrough from HEIF into the WebP container
+ */
+
+#include "metadata.h"
+
+#include <cstring>
+#include <sstream>
+
+#include <webp/mux.h>
+
+namespace {
+
+constexpr uint16_t kOrientationTag = 0x0112;
+constexpr uint16_t kTiffShort = 3;
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint16_t read_u16(const uint8_t* p, bool little_endian) {
+    return little_endian ? uint16_t(p[0] | (p[1] << 8)) : uint16_t((p[0] << 8) | p[1]);
+}
+
+uint32_t read_u32(const uint8_t* p, bool little_endian) {
+    return little_endian ? uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)
+                         : read_be32(p);
+}
+
+// Patches the IFD0 orientation entry in place; anything unexpected is left alone
+void reset_exif_orientation(std::vector<uint8_t>& tiff) {
+    if (tiff.size() < 8) return;
+    bool le = tiff[0] == 'I' && tiff[1] == 'I';
+    bool be = tiff[0] == 'M' && tiff[1] == 'M';
+    if (!le && !be) return;
+
+    size_t ifd = read_u32(&tiff[4], le);
+    if (ifd + 2 > tiff.size()) return;
+    uint16_t entries = read_u16(&tiff[ifd], le);
+
+    for (uint16_t i = 0; i < entries; i++) {
+        size_t entry = ifd + 2 + size_t(i) * 12;
+        if (entry + 12 > tiff.size()) return;
+        if (read_u16(&tiff[entry], le) != kOrientationTag) continue;
+        if (read_u16(&tiff[entry + 2], le) != kTiffShort) return;
+
+        // SHORT values are stored left-aligned in the 4-byte value field
+        uint8_t* value = &tiff[entry + 8];
+        value[0] = le ? 1 : 0;
+        value[1] = le ? 0 : 1;
+        return;
+    }
+}
+
+std::vector<uint8_t> read_block(const heif_image_handle* handle, heif_item_id id) {
+    std::vector<uint8_t> data(heif_image_handle_get_metadata_size(handle, id));
+    heif_error err = heif_image_handle_get_metadata(handle, id, data.data());
+    if (err.code != heif_error_Ok) data.clear();
+    return data;
+}
+
+void read_exif(const heif_image_handle* handle, std::vector<uint8_t>& exif) {
+    heif_item_id id;
+    if (heif_image_handle_get_list_of_metadata_block_IDs(handle, "Exif", &id, 1) < 1) return;
+
+    std::vector<uint8_t> block = read_block(handle, id);
+
+    // HEIF prefixes the TIFF data with a big-endian offset to the TIFF header
+    if (block.size() < 4) return;
+    size_t start = 4 + size_t(read_be32(block.data()));
+    if (start >= block.size()) return;
+
+    exif.assign(block.begin() + start, block.end());
+    reset_exif_orientation(exif);
+}
+
+void read_xmp(const heif_image_handle* handle, std::vector<uint8_t>& xmp) {
+    heif_item_id id;
+    if (find_xmp_block(handle, id)) {
+        xmp = read_block(handle, id);
+    }
+}
+
+void read_icc(const heif_image_handle* handle, std::vector<uint8_t>& icc) {
+    heif_color_profile_type type = heif_image_handle_get_color_profile_type(handle);
+    if (type != heif_color_profile_type_prof && type != heif_color_profile_type_rICC) return;
+
+    icc.resize(heif_image_handle_get_raw_color_profile_size(handle));
+    heif_error err = heif_image_handle_get_raw_color_profile(handle, icc.data());
+    if (err.code != heif_error_Ok) icc.clear();
+}
+
+bool set_chunk(WebPMux* mux, const char fourcc[4], const std::vector<uint8_t>& data) {
+    if (data.empty()) return true;
+    WebPData chunk = {data.data(), data.size()};
+    return WebPMuxSetChunk(mux, fourcc, &chunk, 0) == WEBP_MUX_OK;
+}
+
+}  // namespace
+
+bool find_xmp_block(const heif_image_handle* handle, heif_item_id& id) {
+    int count = heif_image_handle_get_number_of_metadata_blocks(handle, "mime");
+    if (count <= 0) return false;
+
+    std::vector<heif_item_id> ids(count);
+    heif_image_handle_get_list_of_metadata_block_IDs(handle, "mime", ids.data(), count);
+    for (heif_item_id candidate : ids) {
+        const char* content_type = heif_image_handle_get_metadata_content_type(handle, candidate);
+        if (content_type && std::strcmp(content_type, "application/rdf+xml") == 0) {
+            id = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_metadata_kinds(const std::string& list, unsigned& out) {
+    if (list == "none") {
+        out = kMetadataNone;
+        return true;
+    }
+    if (list == "all") {
+        out = kMetadataAll;
+        return true;
+    }
+
+    unsigned kinds = kMetadataNone;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == "exif") {
+            kinds |= kMetadataExif;
+        } else if (item == "xmp") {
+            kinds |= kMetadataXmp;
+        } else if (item == "icc") {
+            kinds |= kMetadataIcc;
+        } else {
+            return false;
+        }
+    }
+    out = kinds;
+    return true;
+}
+
+void read_metadata(const heif_image_handle* handle, unsigned kinds, ImageMetadata& metadata) {
+    if (kinds & kMetadataExif) read_exif(handle, metadata.exif);
+    if (kinds & kMetadataXmp) read_xmp(handle, metadata.xmp);
+    if (kinds & kMetadataIcc) read_icc(handle, metadata.icc);
+}
+
+bool mux_metadata(const ImageMetadata& metadata, WebPData* webp) {
+    if (metadata.empty()) return true;
+
+    // Chunks reference the source buffers; only the final assembly copies
+    WebPMux* mux = WebPMuxCreate(webp, 0);
+    if (!mux) return false;
+
+    WebPData assembled;
+    WebPDataInit(&assembled);
+    bool ok = set_chunk(mux, "EXIF", metadata.exif) &&
+              set_chunk(mux, "XMP ", metadata.xmp) &&
+              set_chunk(mux, "ICCP", metadata.icc) &&
+              WebPMuxAssemble(mux, &assembled) == WEBP_MUX_OK;
+    WebPMuxDelete(mux);
+
+    if (!ok) {
+        WebPDataClear(&assembled);
+        return false;
+    }
+
+    WebPDataClear(webp);
+    *webp = assembled;
+    return true;
+}
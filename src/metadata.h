@@ -0,0 +1,43 @@
+/**
+ * EXIF/XMP/ICC passthrough from HEIF into the WebP container
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <libheif/heif.h>
+#include <webp/mux_types.h>
+
+enum MetadataKind : unsigned {
+    kMetadataNone = 0,
+    kMetadataExif = 1 << 0,
+    kMetadataXmp = 1 << 1,
+    kMetadataIcc = 1 << 2,
+    kMetadataAll = kMetadataExif | kMetadataXmp | kMetadataIcc,
+};
+
+struct ImageMetadata {
+    std::vector<uint8_t> exif;  // TIFF header onwards, as WebP expects
+    std::vector<uint8_t> xmp;
+    std::vector<uint8_t> icc;
+
+    bool empty() const { return exif.empty() && xmp.empty() && icc.empty(); }
+};
+
+// Parses "none", "all" or a comma separated list of exif, xmp, icc
+bool parse_metadata_kinds(const std::string& list, unsigned& out);
+
+// Finds the XMP packet among the "mime" blocks, which may also hold other
+// content types
+bool find_xmp_block(const heif_image_handle* handle, heif_item_id& id);
+
+// Copies the selected blocks out of the loaded container. libheif applies
+// irot/imir when decoding, so the EXIF orientation tag is reset to 1 to keep
+// viewers from rotating the pixels a second time.
+void read_metadata(const heif_image_handle* handle, unsigned kinds, ImageMetadata& metadata);
+
+// Rewrites `webp` (still or animated) with the metadata chunks added
+bool mux_metadata(const ImageMetadata& metadata, WebPData* webp);
@@ -0,0 +1,396 @@
+/**
+ * Prometheus metrics: live /metrics endpoint and node-exporter textfile
+ */
+
+#include "metrics.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "io_backend.h"
+
+namespace {
+
+constexpr int kStages = static_cast<int>(TraceStage::Write) + 1;
+
+// Upper bounds in seconds; a last, implicit bucket is +Inf
+constexpr double kBuckets[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                               0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+constexpr int kBucketCount = sizeof(kBuckets) / sizeof(kBuckets[0]) + 1;
+
+// Written only by the owning thread, so increments need no atomic
+// read-modify-write; the atomic type only makes scrapes race-free
+struct Counter {
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t v) {
+        value.store(value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+struct Shard {
+    Counter files_ok;
+    Counter files_failed;
+    Counter bytes_in;
+    Counter bytes_out;
+    Counter busy_ns;
+    Counter stage_buckets[kStages][kBucketCount];  // not cumulative
+    Counter stage_sum_ns[kStages];
+};
+
+bool enabled = false;
+std::string textfile_path;
+
+// Shards outlive their threads so counters never go backwards
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Shard>> registry;
+thread_local Shard* thread_shard = nullptr;
+
+std::atomic<int64_t> queue_depth{0};
+std::atomic<int64_t> workers{0};
+std::atomic<int64_t> in_flight_bytes{0};
+
+int listen_fd = -1;
+int stop_pipe[2] = {-1, -1};
+std::thread server;
+
+Shard& shard() {
+    if (!thread_shard) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<Shard>());
+        thread_shard = registry.back().get();
+    }
+    return *thread_shard;
+}
+
+void append_metric(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void append_sample(std::string& out, const std::string& name, const std::string& value) {
+    out += name;
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+void append_sample(std::string& out, const std::string& name, uint64_t value) {
+    append_sample(out, name, std::to_string(value));
+}
+
+void append_sample(std::string& out, const std::string& name, int64_t value) {
+    append_sample(out, name, std::to_string(value));
+}
+
+void append_sample(std::string& out, const std::string& name, double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    append_sample(out, name, std::string(buf));
+}
+
+std::string render() {
+    Shard total;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto& s : registry) {
+            total.files_ok.add(s->files_ok.get());
+            total.files_failed.add(s->files_failed.get());
+            total.bytes_in.add(s->bytes_in.get());
+            total.bytes_out.add(s->bytes_out.get());
+            total.busy_ns.add(s->busy_ns.get());
+            for (int st = 0; st < kStages; st++) {
+                for (int b = 0; b < kBucketCount; b++) {
+                    total.stage_buckets[st][b].add(s->stage_buckets[st][b].get());
+                }
+                total.stage_sum_ns[st].add(s->stage_sum_ns[st].get());
+            }
+        }
+    }
+
+    std::string out;
+    append_metric(out, "heic2webp_files_total", "counter", "Files processed, by result.");
+    append_sample(out, "heic2webp_files_total{result=\"converted\"}", total.files_ok.get());
+    append_sample(out, "heic2webp_files_total{result=\"failed\"}", total.files_failed.get());
+    append_metric(out, "heic2webp_input_bytes_total", "counter", "HEIF bytes read.");
+    append_sample(out, "heic2webp_input_bytes_total", total.bytes_in.get());
+    append_metric(out, "heic2webp_output_bytes_total", "counter", "WebP bytes written.");
+    append_sample(out, "heic2webp_output_bytes_total", total.bytes_out.get());
+
+    append_metric(out, "heic2webp_stage_duration_seconds", "histogram",
+                  "Time spent per file in each pipeline stage.");
+    for (int st = 0; st < kStages; st++) {
+        std::string labels = "{stage=\"" + std::string(trace_stage_name(static_cast<TraceStage>(st)));
+        uint64_t cumulative = 0;
+        for (int b = 0; b < kBucketCount; b++) {
+            cumulative += total.stage_buckets[st][b].get();
+            char le[32];
+            if (b + 1 < kBucketCount) {
+                snprintf(le, sizeof(le), "%g", kBuckets[b]);
+            } else {
+                snprintf(le, sizeof(le), "+Inf");
+            }
+            append_sample(out, "heic2webp_stage_duration_seconds_bucket" + labels + "\",le=\"" + le + "\"}",
+                          cumulative);
+        }
+        append_sample(out, "heic2webp_stage_duration_seconds_sum" + labels + "\"}",
+                      total.stage_sum_ns[st].get() / 1e9);
+        append_sample(out, "heic2webp_stage_duration_seconds_count" + labels + "\"}", cumulative);
+    }
+
+    append_metric(out, "heic2webp_queue_depth", "gauge", "Tasks waiting for a worker.");
+    append_sample(out, "heic2webp_queue_depth", queue_depth.load());
+    append_metric(out, "heic2webp_in_flight_bytes", "gauge",
+                  "Input buffers and decoded frames held by work in progress.");
+    append_sample(out, "heic2webp_in_flight_bytes", in_flight_bytes.load());
+    append_metric(out, "heic2webp_workers", "gauge", "Worker threads.");
+    append_sample(out, "heic2webp_workers", workers.load());
+    append_metric(out, "heic2webp_worker_busy_seconds_total", "counter",
+                  "Worker time spent running tasks; divide its rate by heic2webp_workers "
+                  "for utilization.");
+    append_sample(out, "heic2webp_worker_busy_seconds_total", total.busy_ns.get() / 1e9);
+    return out;
+}
+
+int listen_on(const std::string& listen) {
+    int fd;
+    if (listen.rfind("unix:", 0) == 0) {
+        std::string path = listen.substr(5);
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "❌ Invalid metrics socket path: " << path << std::endl;
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        // Replace the stale socket of an earlier run, never a regular file
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(path.c_str());
+        }
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "❌ Cannot listen on " << path << ": " << strerror(errno) << std::endl;
+            if (fd >= 0) ::close(fd);
+            return -1;
+        }
+    } else {
+        char* end;
+        long port = strtol(listen.c_str(), &end, 10);
+        if (listen.empty() || *end != '\0' || port < 1 || port > 65535) {
+            std::cerr << "❌ Metrics listen address must be a port or unix:<path>" << std::endl;
+            return -1;
+        }
+        // Loopback only: the endpoint has no authentication
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "❌ Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << std::endl;
+            if (fd >= 0) ::close(fd);
+            return -1;
+        }
+    }
+
+    if (::listen(fd, 16) != 0) {
+        std::cerr << "❌ Cannot listen for metrics: " << strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void respond(int fd) {
+    // Scrapers send small requests; give up on clients that stall
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0) {
+        body = render();
+    } else {
+        status = "404 Not Found";
+        body = "Only /metrics is served\n";
+    }
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    write_stream(fd, reinterpret_cast<const uint8_t*>(response.data()), response.size());
+}
+
+void serve() {
+    for (;;) {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            respond(fd);
+            ::close(fd);
+        }
+    }
+}
+
+bool write_textfile() {
+    // Written aside and renamed, so the collector never reads a partial file
+    std::string body = render();
+    std::string tmp = textfile_path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_stream(fd, reinterpret_cast<const uint8_t*>(body.data()), body.size());
+    ok = fd >= 0 && ::close(fd) == 0 && ok;
+    ok = ok && ::rename(tmp.c_str(), textfile_path.c_str()) == 0;
+    if (!ok) {
+        std::cerr << "❌ Failed to write metrics: " << textfile_path << std::endl;
+        ::unlink(tmp.c_str());
+    }
+    return ok;
+}
+
+void stop_metrics() {
+    if (server.joinable()) {
+        char byte = 0;
+        ssize_t ignored = ::write(stop_pipe[1], &byte, 1);
+        (void)ignored;
+        server.join();
+        ::close(listen_fd);
+    }
+    if (!textfile_path.empty()) {
+        write_textfile();
+    }
+}
+
+}  // namespace
+
+bool start_metrics(const std::string& listen, const std::string& textfile) {
+    if (!listen.empty()) {
+        listen_fd = listen_on(listen);
+        if (listen_fd < 0) {
+            return false;
+        }
+        if (::pipe2(stop_pipe, O_CLOEXEC) != 0) {
+            std::cerr << "❌ Cannot start metrics server: " << strerror(errno) << std::endl;
+            return false;
+        }
+        server = std::thread(serve);
+    }
+    textfile_path = textfile;
+    enabled = true;
+    std::atexit(stop_metrics);
+    return true;
+}
+
+bool metrics_enabled() {
+    return enabled;
+}
+
+void count_file(bool ok) {
+    if (!enabled) return;
+    (ok ? shard().files_ok : shard().files_failed).add(1);
+}
+
+void count_input_bytes(uint64_t bytes) {
+    if (enabled) shard().bytes_in.add(bytes);
+}
+
+void count_output_bytes(uint64_t bytes) {
+    if (enabled) shard().bytes_out.add(bytes);
+}
+
+void count_busy_time(int64_t ns) {
+    if (enabled) shard().busy_ns.add(static_cast<uint64_t>(ns));
+}
+
+void observe_stage(TraceStage stage, int64_t ns) {
+    if (!enabled) return;
+    double seconds = ns / 1e9;
+    int b = 0;
+    while (b + 1 < kBucketCount && seconds > kBuckets[b]) {
+        b++;
+    }
+    Shard& s = shard();
+    s.stage_buckets[static_cast<int>(stage)][b].add(1);
+    s.stage_sum_ns[static_cast<int>(stage)].add(static_cast<uint64_t>(ns));
+}
+
+void adjust_queue_depth(int64_t delta) {
+    if (enabled) queue_depth += delta;
+}
+
+void adjust_workers(int64_t delta) {
+    if (enabled) workers += delta;
+}
+
+MemoryCharge::~MemoryCharge() {
+    if (bytes_ > 0) {
+        in_flight_bytes -= static_cast<int64_t>(bytes_);
+    }
+}
+
+MemoryCharge::MemoryCharge(MemoryCharge&& other) noexcept : bytes_(other.bytes_) {
+    other.bytes_ = 0;
+}
+
+MemoryCharge& MemoryCharge::operator=(MemoryCharge&& other) noexcept {
+    if (this != &other) {
+        if (bytes_ > 0) {
+            in_flight_bytes -= static_cast<int64_t>(bytes_);
+        }
+        bytes_ = other.bytes_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+void MemoryCharge::add(size_t bytes) {
+    if (!enabled) return;
+    bytes_ += bytes;
+    in_flight_bytes += static_cast<int64_t>(bytes);
+}
@@ -0,0 +1,43 @@
+/**
+ * Prometheus metrics: live /metrics endpoint and node-exporter textfile
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "trace.h"
+
+// Enables collection. `listen` is a TCP port served on 127.0.0.1 or
+// "unix:<path>", empty for none; `textfile` is written when the process
+// exits, empty for none. Call before any worker thread starts.
+bool start_metrics(const std::string& listen, const std::string& textfile);
+
+bool metrics_enabled();
+
+// Counters. Each thread adds to its own shard; shards are summed on scrape.
+void count_file(bool ok);
+void count_input_bytes(uint64_t bytes);
+void count_output_bytes(uint64_t bytes);
+void count_busy_time(int64_t ns);  // worker time spent running tasks
+void observe_stage(TraceStage stage, int64_t ns);
+
+// Gauges
+void adjust_queue_depth(int64_t delta);
+void adjust_workers(int64_t delta);
+
+// Holds `bytes` in the in-flight memory gauge until destroyed
+class MemoryCharge {
+public:
+    MemoryCharge() = default;
+    ~MemoryCharge();
+    MemoryCharge(MemoryCharge&& other) noexcept;
+    MemoryCharge& operator=(MemoryCharge&& other) noexcept;
+
+    void add(size_t bytes);
+
+private:
+    size_t bytes_ = 0;
+};
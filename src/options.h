@@ -0,0 +1,53 @@
+/**
+ * Command-line options shared by the conversion stages
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "encoder.h"
+#include "io_backend.h"
+#include "metadata.h"
+#include "probe.h"
+#include "tonemap.h"
+
+struct Options {
+    std::string input;
+    std::string output_dir;
+    int quality = 85;
+    int alpha_quality = 100;
+    int alpha_filter = 1;  // 0 = none, 1 = fast, 2 = best
+    int method = 4;        // WebP effort, 0 = fastest .. 6 = smallest
+    size_t degrade_queue = 0;  // bulk files waiting before bulk work uses method 0; 0 = never
+    bool sharp_yuv = false;
+    std::vector<OutputFormat> formats = {OutputFormat::WebP};
+    ToneMap tone_map = ToneMap::Auto;
+    unsigned metadata = kMetadataNone;  // MetadataKind bits
+    bool animate = false;
+    int frame_delay = 100;  // milliseconds per animation frame
+    bool all_images = false;
+    unsigned jobs = 0;  // 0 = one worker per hardware thread
+    bool adaptive_jobs = false;  // -j auto: tune the worker count while running
+    IoMode io_mode = IoMode::Sync;
+    unsigned io_depth = 64;      // io_uring submission queue entries
+    bool durable = false;
+    int sync_batch = 64;         // outputs per group commit in durable mode
+    int sync_interval = 1000;    // milliseconds between group commits
+    std::string files_from;
+    std::string journal;
+    bool resume = false;
+    ArchiveFormat archive = ArchiveFormat::None;  // forced input format, e.g. for stdin
+    std::string tar_out;                          // tar stream output, "-" for stdout
+    bool ordered = false;                         // tar entries in input order
+    bool dedup = false;
+    ProbeFormat probe = ProbeFormat::None;  // inventory instead of conversion
+    bool recursive = false;
+    bool verbose = false;
+    bool startup_profile = false;
+    std::string trace;  // Chrome trace-event JSON of per-file stages
+    std::string metrics_listen;    // port on 127.0.0.1 or unix:<path>
+    std::string metrics_textfile;  // node-exporter .prom file written at exit
+};
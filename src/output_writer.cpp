@@ -0,0 +1,308 @@
+/**
+ * Crash-safe output writes: temp file + atomic rename, with batched fsync
+ */
+
+#include "output_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io_backend.h"
+
+namespace {
+
+struct PendingOutput {
+    fs::path temp;
+    fs::path final;
+};
+
+struct DurableState {
+    bool enabled = false;
+    size_t batch_files = 64;
+    std::chrono::milliseconds interval{1000};
+
+    std::mutex mutex;               // guards `pending` and `stopping`
+    std::mutex commit_mutex;        // serializes group commits; held while taking a batch
+    std::condition_variable timer_cv;
+    std::vector<PendingOutput> pending;
+    bool stopping = false;
+    bool failed = false;
+    std::thread timer;
+};
+
+DurableState durable;
+std::atomic<unsigned> temp_counter{0};
+
+// Temp files that exist on disk, for cleanup on a forced exit
+std::mutex temps_mutex;
+std::unordered_set<std::string> temps;
+
+void track_temp(const fs::path& temp) {
+    std::lock_guard<std::mutex> lock(temps_mutex);
+    temps.insert(temp.native());
+}
+
+void discard_temp(const fs::path& temp) {
+    ::unlink(temp.c_str());
+    std::lock_guard<std::mutex> lock(temps_mutex);
+    temps.erase(temp.native());
+}
+
+// Renames `temp` into place or, when that fails, removes it
+bool finish_temp(const fs::path& temp, const fs::path& final) {
+    if (::rename(temp.c_str(), final.c_str()) != 0) {
+        discard_temp(temp);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(temps_mutex);
+    temps.erase(temp.native());
+    return true;
+}
+
+std::mutex dirs_mutex;
+std::unordered_set<std::string> created_dirs;
+
+fs::path temp_path_for(const fs::path& path) {
+    std::string name = "." + path.filename().string() + ".tmp." + 
+                       std::to_string(getpid()) + "." + std::to_string(temp_counter++);
+    return path.parent_path() / name;
+}
+
+bool fsync_path(const fs::path& path, int flags) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Makes the data of every pending temp file durable with as few syncs as possible
+bool sync_batch_data(const std::vector<PendingOutput>& batch) {
+#ifdef __linux__
+    // One syncfs per filesystem instead of one fsync per file
+    std::set<dev_t> synced;
+    for (const auto& out : batch) {
+        struct stat st;
+        if (::stat(out.temp.c_str(), &st) != 0) return false;
+        if (!synced.insert(st.st_dev).second) continue;
+
+        int fd = ::open(out.temp.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        bool ok = ::syncfs(fd) == 0;
+        ::close(fd);
+        if (!ok) return false;
+    }
+    return true;
+#else
+    for (const auto& out : batch) {
+        if (!fsync_path(out.temp, O_RDONLY)) return false;
+    }
+    return true;
+#endif
+}
+
+// Called with commit_mutex held. Returns false if any output failed.
+bool commit_batch(std::vector<PendingOutput> batch) {
+    if (batch.empty()) return true;
+
+    // Data must be on disk before the rename makes it visible under the final name
+    bool ok = sync_batch_data(batch);
+    bool all_ok = ok;
+
+    std::set<fs::path> dirs;
+    for (const auto& out : batch) {
+        if (ok && finish_temp(out.temp, out.final)) {
+            dirs.insert(out.final.parent_path());
+            continue;
+        }
+        if (!ok) {
+            discard_temp(out.temp);
+        }
+        std::cerr << "❌ Failed to commit output: " << out.final << std::endl;
+        durable.failed = true;
+        all_ok = false;
+    }
+
+    // One directory fsync covers every rename made into it
+    for (const auto& dir : dirs) {
+        if (!fsync_path(dir.empty() ? fs::path(".") : dir, O_RDONLY | O_DIRECTORY)) {
+            std::cerr << "❌ Failed to sync directory: " << dir << std::endl;
+            durable.failed = true;
+            all_ok = false;
+        }
+    }
+    return all_ok;
+}
+
+// Taking the batch under commit_mutex means that once a caller holds it, no
+// earlier batch is still on its way to being committed
+bool commit_pending() {
+    std::lock_guard<std::mutex> commit_lock(durable.commit_mutex);
+    std::vector<PendingOutput> batch;
+    {
+        std::lock_guard<std::mutex> lock(durable.mutex);
+        batch.swap(durable.pending);
+    }
+    return commit_batch(std::move(batch));
+}
+
+void commit_timer() {
+    std::unique_lock<std::mutex> lock(durable.mutex);
+    while (!durable.stopping) {
+        durable.timer_cv.wait_for(lock, durable.interval);
+        lock.unlock();
+        commit_pending();
+        lock.lock();
+    }
+}
+
+}  // namespace
+
+bool ensure_output_dir(const fs::path& dir) {
+    if (dir.empty()) return true;
+
+    std::lock_guard<std::mutex> lock(dirs_mutex);
+    if (created_dirs.count(dir.native())) return true;
+
+    std::error_code ec;
+    bool created = fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "❌ Failed to create output directory: " << dir << std::endl;
+        return false;
+    }
+    // Durable outputs need the new directory entry on disk as well
+    if (created && durable.enabled) {
+        fsync_path(dir.parent_path().empty() ? fs::path(".") : dir.parent_path(), 
+                   O_RDONLY | O_DIRECTORY);
+    }
+    created_dirs.insert(dir.native());
+    return true;
+}
+
+bool ensure_output_dirs(const std::vector<fs::path>& outputs) {
+    std::set<fs::path> dirs;
+    for (const auto& output : outputs) {
+        dirs.insert(output.parent_path());
+    }
+
+    bool ok = true;
+    for (const auto& dir : dirs) {
+        ok = ensure_output_dir(dir) && ok;
+    }
+    return ok;
+}
+
+void configure_durable_outputs(size_t batch_files, int batch_interval_ms) {
+    durable.enabled = true;
+    durable.batch_files = std::max<size_t>(batch_files, 1);
+    durable.interval = std::chrono::milliseconds(batch_interval_ms);
+    durable.timer = std::thread(commit_timer);
+}
+
+bool write_output_file(const fs::path& path, const uint8_t* data, size_t size,
+                       const std::vector<fs::path>& links) {
+    std::vector<PendingOutput> outputs;
+    auto discard = [&outputs] {
+        for (const auto& out : outputs) discard_temp(out.temp);
+    };
+
+    for (size_t i = 0; i <= links.size(); i++) {
+        const fs::path& final = i == 0 ? path : links[i - 1];
+        if (!ensure_output_dir(final.parent_path())) {
+            discard();
+            return false;
+        }
+        fs::path temp = temp_path_for(final);
+
+        // Later outputs share the first one's inode unless they are on another filesystem
+        if (i > 0 && ::link(outputs[0].temp.c_str(), temp.c_str()) == 0) {
+            track_temp(temp);
+            outputs.push_back({temp, final});
+            continue;
+        }
+
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            std::cerr << "❌ Failed to create output file: " << final << std::endl;
+            discard();
+            return false;
+        }
+        track_temp(temp);
+        outputs.push_back({temp, final});
+
+        bool ok = write_file(fd, data, size);
+        ok = (::close(fd) == 0) && ok;
+        if (!ok) {
+            std::cerr << "❌ Failed to write output file: " << final << std::endl;
+            discard();
+            return false;
+        }
+    }
+
+    if (!durable.enabled) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (!finish_temp(outputs[i].temp, outputs[i].final)) {
+                std::cerr << "❌ Failed to rename output file: " << outputs[i].final << std::endl;
+                for (i++; i < outputs.size(); i++) discard_temp(outputs[i].temp);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(durable.mutex);
+        durable.pending.insert(durable.pending.end(), outputs.begin(), outputs.end());
+        full = durable.pending.size() >= durable.batch_files;
+    }
+    if (full) {
+        commit_pending();
+    }
+    return true;
+}
+
+bool flush_outputs() {
+    if (!durable.enabled) return true;
+
+    {
+        std::lock_guard<std::mutex> lock(durable.mutex);
+        durable.stopping = true;
+    }
+    durable.timer_cv.notify_all();
+    if (durable.timer.joinable()) {
+        durable.timer.join();
+    }
+
+    commit_pending();
+    return !durable.failed;
+}
+
+bool commit_outputs() {
+    if (!durable.enabled) return true;
+    return commit_pending();
+}
+
+void remove_temp_outputs() {
+    std::lock_guard<std::mutex> lock(temps_mutex);
+    for (const auto& temp : temps) {
+        ::unlink(temp.c_str());
+    }
+    temps.clear();
+}
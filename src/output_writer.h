@@ -0,0 +1,46 @@
+/**
+ * Crash-safe output writes: temp file + atomic rename, with batched fsync
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Enables durable mode. Renames are then held back and committed as a group
+// after one filesystem sync, every `batch_files` outputs or `batch_interval_ms`,
+// whichever comes first. Call once before the first write.
+void configure_durable_outputs(size_t batch_files, int batch_interval_ms);
+
+// Creates output directories, each at most once per run. Later calls for a
+// known directory are a cache lookup, not a syscall. Thread-safe.
+bool ensure_output_dir(const fs::path& dir);
+
+// Creates the parent directories of `outputs` up front in one pass, so workers
+// only ever hit the cache
+bool ensure_output_dirs(const std::vector<fs::path>& outputs);
+
+// Writes to a temp file in the destination directory and renames it over
+// `path`, so readers never see a partial file. In durable mode the rename
+// happens at the next group commit. Missing parent directories are created
+// through ensure_output_dir(). Each of `links` gets the same content, as a
+// hard link of the temp file where possible and a copy otherwise.
+bool write_output_file(const fs::path& path, const uint8_t* data, size_t size,
+                       const std::vector<fs::path>& links = {});
+
+// Commits outstanding durable outputs and stops the commit timer
+bool flush_outputs();
+
+// Commits every durable output written so far before returning, without
+// stopping the timer. Returns false if any of them failed; true outside
+// durable mode.
+bool commit_outputs();
+
+// Unlinks every temp file not yet renamed into place, including durable
+// outputs waiting for their group commit. For a forced exit; writes still in
+// progress may fail afterwards.
+void remove_temp_outputs();
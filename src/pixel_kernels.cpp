@@ -0,0 +1,324 @@
+/**
+ * Per-pixel kernels specialized at compile time on the frame's pixel layout
+ */
+
+#include "pixel_kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// 4x4 Bayer matrix scaled to 8.8 fixed point thresholds (8..248)
+constexpr uint16_t kBayer[4][4] = {
+    {  8, 136,  40, 168},
+    {200,  72, 232, 104},
+    { 56, 184,  24, 152},
+    {248, 120, 216,  88},
+};
+
+inline uint32_t load_le16(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+template <int BitDepth>
+inline uint8_t tone_map_sample(const uint8_t* in, uint32_t threshold, const uint16_t* lut) {
+    // Out-of-range codes only exist below 16 bits; the clamp folds away at 16
+    uint32_t v = std::min(load_le16(in), (1u << BitDepth) - 1);
+    return static_cast<uint8_t>((lut[v] + threshold) >> 8);
+}
+
+// Channels are spelled out rather than looped so every pixel is straight-line code
+template <int Channels, int BitDepth>
+inline void tone_map_pixel(const uint8_t* in, uint8_t* out, uint32_t threshold, const uint16_t* lut) {
+    out[0] = tone_map_sample<BitDepth>(in, threshold, lut);
+    out[1] = tone_map_sample<BitDepth>(in + 2, threshold, lut);
+    out[2] = tone_map_sample<BitDepth>(in + 4, threshold, lut);
+    if constexpr (Channels == 4) {
+        // Constant divisor: compiled to a multiply and shift
+        constexpr uint32_t kMaxCode = (1u << BitDepth) - 1;
+        uint32_t a = std::min(load_le16(in + 6), kMaxCode);
+        out[3] = static_cast<uint8_t>((a * 255 + kMaxCode / 2) / kMaxCode);
+    }
+}
+
+template <int Channels, int BitDepth>
+void tone_map_kernel(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                     int width, int height, const uint16_t* lut) {
+    static_assert(Channels == 3 || Channels == 4, "RGB or RGBA");
+    static_assert(BitDepth > 8 && BitDepth <= 16, "high bit depth only");
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t* in = src + static_cast<size_t>(y) * src_stride;
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_stride;
+        const uint16_t* dither = kBayer[y & 3];
+
+        // Four pixels per step, one per dither column, so thresholds are constants
+        const uint32_t t0 = dither[0], t1 = dither[1], t2 = dither[2], t3 = dither[3];
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            tone_map_pixel<Channels, BitDepth>(in, out, t0, lut);
+            tone_map_pixel<Channels, BitDepth>(in + 2 * Channels, out + Channels, t1, lut);
+            tone_map_pixel<Channels, BitDepth>(in + 4 * Channels, out + 2 * Channels, t2, lut);
+            tone_map_pixel<Channels, BitDepth>(in + 6 * Channels, out + 3 * Channels, t3, lut);
+            in += 8 * Channels;
+            out += 4 * Channels;
+        }
+        for (; x < width; x++) {
+            tone_map_pixel<Channels, BitDepth>(in, out, dither[x & 3], lut);
+            in += 2 * Channels;
+            out += Channels;
+        }
+    }
+}
+
+// libwebp's RGB -> YUV constants (src/dsp/yuv.h), 16-bit fixed point
+constexpr int kYuvFix = 16;
+constexpr int kYuvHalf = 1 << (kYuvFix - 1);
+constexpr int kYRounding = kYuvHalf + (16 << kYuvFix);
+// Chroma works on sums of four pixels, hence two extra fraction bits
+constexpr int kUVRounding = (kYuvHalf << 2) + (128 << (kYuvFix + 2));
+
+inline uint8_t rgb_to_y(int r, int g, int b) {
+    return static_cast<uint8_t>((16839 * r + 33059 * g + 6420 * b + kYRounding) >> kYuvFix);
+}
+
+inline uint8_t clip_uv(int uv) {
+    uv >>= kYuvFix + 2;
+    return static_cast<uint8_t>(std::clamp(uv, 0, 255));
+}
+
+inline uint8_t rgb4_to_u(int r, int g, int b) {
+    return clip_uv(-9719 * r - 19081 * g + 28800 * b + kUVRounding);
+}
+
+inline uint8_t rgb4_to_v(int r, int g, int b) {
+    return clip_uv(28800 * r - 24116 * g - 4684 * b + kUVRounding);
+}
+
+// libwebp averages chroma in a gamma-compressed space (picture_csp_enc.c),
+// which keeps saturated edges from darkening. Same tables, same rounding.
+constexpr int kGammaFix = 12;
+constexpr int kGammaTabFix = 7;
+constexpr int kGammaTabSize = 1 << (kGammaFix - kGammaTabFix);
+
+constexpr int kGammaScale = (1 << kGammaFix) - 1;
+
+struct GammaTables {
+    uint16_t to_linear[256];
+    // Sum of four linear values → gamma value times four. libwebp interpolates
+    // a 33-entry table per block; every possible sum is precomputed here.
+    uint16_t sum_to_gamma[4 * kGammaScale + 1];
+
+    GammaTables() {
+        const double gamma = 0.80;
+        for (int v = 0; v <= 255; v++) {
+            to_linear[v] = static_cast<uint16_t>(std::pow(v / 255.0, gamma) * kGammaScale + .5);
+        }
+
+        int to_gamma[kGammaTabSize + 1];
+        for (int v = 0; v <= kGammaTabSize; v++) {
+            double linear = static_cast<double>(1 << kGammaTabFix) / kGammaScale * v;
+            to_gamma[v] = static_cast<int>(255. * std::pow(linear, 1. / gamma) + .5);
+        }
+        const int period = (1 << kGammaTabFix) << 2;
+        for (int sum = 0; sum <= 4 * kGammaScale; sum++) {
+            int pos = sum >> (kGammaTabFix + 2);
+            int frac = sum & (period - 1);
+            int y = to_gamma[pos + 1] * frac + to_gamma[pos] * (period - frac);
+            sum_to_gamma[sum] = static_cast<uint16_t>((y + (1 << (kGammaTabFix - 1))) >> kGammaTabFix);
+        }
+    }
+};
+
+const GammaTables& gamma_tables() {
+    static const GammaTables tables;
+    return tables;
+}
+
+// Planar 16-bit copy of one RGB row for the SIMD luma pass
+struct PlanarRow {
+    std::vector<int16_t> r, g, b;
+
+    void resize(int width) {
+        r.resize(width);
+        g.resize(width);
+        b.resize(width);
+    }
+
+    void load(const uint8_t* rgb, int width) {
+        int16_t* pr = r.data();
+        int16_t* pg = g.data();
+        int16_t* pb = b.data();
+        for (int x = 0; x < width; x++, rgb += 3) {
+            pr[x] = rgb[0];
+            pg[x] = rgb[1];
+            pb[x] = rgb[2];
+        }
+    }
+};
+
+// Gamma-space sums of the 2x2 blocks of two interleaved RGB rows. Table
+// lookups, so this stays scalar.
+void sum_blocks(const uint8_t* top, const uint8_t* bottom, int width, const GammaTables& gamma,
+                int16_t* sums_r, int16_t* sums_g, int16_t* sums_b) {
+    const uint16_t* lin = gamma.to_linear;
+    // `next` is the offset of the block's right-hand pixel
+    auto block = [&](int c, int next) {
+        int sum = lin[top[c]] + lin[top[c + next]] + lin[bottom[c]] + lin[bottom[c + next]];
+        return static_cast<int16_t>(gamma.sum_to_gamma[sum]);
+    };
+
+    int i = 0;
+    for (int x = 0; x + 1 < width; x += 2, i++, top += 6, bottom += 6) {
+        sums_r[i] = block(0, 3);
+        sums_g[i] = block(1, 3);
+        sums_b[i] = block(2, 3);
+    }
+    if (width & 1) {
+        // The last column is repeated
+        sums_r[i] = block(0, 0);
+        sums_g[i] = block(1, 0);
+        sums_b[i] = block(2, 0);
+    }
+}
+
+#ifdef __SSE2__
+// Y for 8 pixels. 33059 doesn't fit a signed 16-bit multiplier, so green is
+// split across the (R,G) and (G,B) madd pairs, as libwebp's SSE2 code does.
+inline void y_row_sse2(const int16_t* r, const int16_t* g, const int16_t* b, uint8_t* y) {
+    const __m128i k_rg = _mm_set1_epi32((16675 << 16) | 16839);
+    const __m128i k_gb = _mm_set1_epi32((6420 << 16) | 16384);
+    const __m128i rounding = _mm_set1_epi32(kYRounding);
+
+    __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r));
+    __m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vr, vg), k_rg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(vg, vb), k_gb));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vr, vg), k_rg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(vg, vb), k_gb));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, rounding), kYuvFix);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, rounding), kYuvFix);
+
+    __m128i y16 = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(y), _mm_packus_epi16(y16, y16));
+}
+
+// One chroma plane for 8 blocks: (R,G) pairs times (kr,kg) plus (B,0) pairs times (kb,0)
+inline void uv_row_sse2(__m128i r, __m128i g, __m128i b, int kr, int kg, int kb, uint8_t* out) {
+    // kg is negative for both planes; shift it as unsigned, a signed left shift is undefined
+    const __m128i k_rg = _mm_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(kg) << 16) |
+                                                             (static_cast<uint32_t>(kr) & 0xffff)));
+    const __m128i k_b = _mm_set1_epi32(kb);
+    const __m128i rounding = _mm_set1_epi32(kUVRounding);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), k_rg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(b, zero), k_b));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), k_rg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(b, zero), k_b));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, rounding), kYuvFix + 2);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, rounding), kYuvFix + 2);
+
+    // packus clips to 0..255 like libwebp's VP8ClipUV
+    __m128i uv16 = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(uv16, uv16));
+}
+#endif
+
+void rgb_to_yuv420_kernel(const uint8_t* rgb, int stride, int width, int height,
+                          uint8_t* y_plane, int y_stride, uint8_t* u_plane, uint8_t* v_plane,
+                          int uv_stride) {
+    const GammaTables& gamma = gamma_tables();
+    const int uv_width = (width + 1) / 2;
+
+    // Row scratch is kept per thread, so workers only grow it for wider images
+    thread_local PlanarRow rows[2];
+    thread_local std::vector<int16_t> sums_r, sums_g, sums_b;
+    for (PlanarRow& row : rows) row.resize(width);
+    for (auto* sums : {&sums_r, &sums_g, &sums_b}) sums->resize(uv_width);
+
+    for (int y = 0; y < height; y += 2) {
+        // An odd last row is paired with itself
+        int pair = y + 1 < height ? 2 : 1;
+        const uint8_t* top = rgb + static_cast<size_t>(y) * stride;
+        const uint8_t* bottom = top + static_cast<size_t>(pair - 1) * stride;
+
+        for (int i = 0; i < pair; i++) {
+            PlanarRow& row = rows[i];
+            row.load(i == 0 ? top : bottom, width);
+            uint8_t* out = y_plane + static_cast<size_t>(y + i) * y_stride;
+            int x = 0;
+#ifdef __SSE2__
+            for (; x + 8 <= width; x += 8) {
+                y_row_sse2(&row.r[x], &row.g[x], &row.b[x], out + x);
+            }
+#endif
+            for (; x < width; x++) {
+                out[x] = rgb_to_y(row.r[x], row.g[x], row.b[x]);
+            }
+        }
+
+        sum_blocks(top, bottom, width, gamma, sums_r.data(), sums_g.data(), sums_b.data());
+
+        uint8_t* u = u_plane + static_cast<size_t>(y / 2) * uv_stride;
+        uint8_t* v = v_plane + static_cast<size_t>(y / 2) * uv_stride;
+        int ux = 0;
+#ifdef __SSE2__
+        for (; ux + 8 <= uv_width; ux += 8) {
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums_r[ux]));
+            __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums_g[ux]));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums_b[ux]));
+            uv_row_sse2(r, g, b, -9719, -19081, 28800, u + ux);
+            uv_row_sse2(r, g, b, 28800, -24116, -4684, v + ux);
+        }
+#endif
+        for (; ux < uv_width; ux++) {
+            u[ux] = rgb4_to_u(sums_r[ux], sums_g[ux], sums_b[ux]);
+            v[ux] = rgb4_to_v(sums_r[ux], sums_g[ux], sums_b[ux]);
+        }
+    }
+}
+
+constexpr int kMinDepth = 8;
+constexpr int kMaxDepth = 16;
+constexpr int kDepths = kMaxDepth - kMinDepth + 1;
+
+template <int Channels, int BitDepth>
+constexpr PixelKernels make_kernels() {
+    PixelKernels kernels;
+    if constexpr (BitDepth > 8) {
+        kernels.tone_map = &tone_map_kernel<Channels, BitDepth>;
+    } else if constexpr (Channels == 3) {
+        kernels.rgb_to_yuv420 = &rgb_to_yuv420_kernel;
+    }
+    return kernels;
+}
+
+template <int Channels, size_t... I>
+constexpr auto make_row(std::index_sequence<I...>) {
+    return std::array<PixelKernels, sizeof...(I)>{make_kernels<Channels, kMinDepth + int(I)>()...};
+}
+
+// [has alpha][bit depth - 8]
+const std::array<std::array<PixelKernels, kDepths>, 2> kKernelTable = {
+    make_row<3>(std::make_index_sequence<kDepths>()),
+    make_row<4>(std::make_index_sequence<kDepths>()),
+};
+
+}  // namespace
+
+const PixelKernels& select_kernels(const PixelFormat& format) {
+    int depth = std::clamp(format.bit_depth, kMinDepth, kMaxDepth);
+    return kKernelTable[format.channels == 4 ? 1 : 0][depth - kMinDepth];
+}
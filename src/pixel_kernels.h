@@ -0,0 +1,36 @@
+/**
+ * Per-pixel kernels specialized at compile time on the frame's pixel layout
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Layout of an interleaved frame as decoded by libheif. Chroma is always
+// upsampled to interleaved RGB(A) by the decoder, so it is not a parameter.
+struct PixelFormat {
+    int channels = 3;   // 3 = RGB, 4 = RGBA
+    int bit_depth = 8;  // significant bits per sample, 8..16
+};
+
+// Maps little-endian 16-bit samples through `lut` (code value → 8.8 fixed
+// point) with ordered dithering; alpha is rescaled to 8 bits
+using ToneMapKernel = void (*)(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                               int width, int height, const uint16_t* lut);
+
+// Converts 8-bit RGB to YUV 4:2:0 planes with the same fixed-point maths as
+// libwebp's own import: BT.601 coefficients, chroma averaged over 2x2 blocks
+// in gamma-compressed space, odd edges repeating the last row or column.
+using RgbToYuvKernel = void (*)(const uint8_t* rgb, int stride, int width, int height,
+                                uint8_t* y, int y_stride, uint8_t* u, uint8_t* v, int uv_stride);
+
+// Kernels for one pixel format. Entries that don't apply (tone mapping an
+// 8-bit frame) are null.
+struct PixelKernels {
+    ToneMapKernel tone_map = nullptr;
+    RgbToYuvKernel rgb_to_yuv420 = nullptr;  // 8-bit RGB only
+};
+
+// Returns the kernels instantiated for `format`. Callers look them up once per
+// image, so the inner loops never test the channel count or bit depth.
+const PixelKernels& select_kernels(const PixelFormat& format);
@@ -0,0 +1,173 @@
+/**
+ * Header-only inventory of HEIF files (--probe)
+ */
+
+#include "probe.h"
+
+#include <cstdio>
+#include <memory>
+#include <system_error>
+
+#include <libheif/heif.h>
+
+#include "io_backend.h"
+#include "metadata.h"
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+namespace {
+
+constexpr size_t kFlushBytes = 64 * 1024;
+
+std::string csv_field(const std::string& s) {
+    if (s.find_first_of(",\"\n\r") == std::string::npos) return s;
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+const char* json_bool(bool b) { return b ? "true" : "false"; }
+
+std::string json_record(const ProbeInfo& info) {
+    std::string out = "{\"path\":" + json_string(info.path.string()) +
+                      ",\"bytes\":" + std::to_string(info.file_size);
+    if (!info.error.empty()) {
+        return out + ",\"error\":" + json_string(info.error) + "}";
+    }
+    out += ",\"images\":" + std::to_string(info.images);
+    out += ",\"width\":" + std::to_string(info.width);
+    out += ",\"height\":" + std::to_string(info.height);
+    out += ",\"ispe_width\":" + std::to_string(info.ispe_width);
+    out += ",\"ispe_height\":" + std::to_string(info.ispe_height);
+    out += ",\"bit_depth\":" + std::to_string(info.bit_depth);
+    out += ",\"alpha\":" + std::string(json_bool(info.alpha));
+    out += ",\"depth\":" + std::string(json_bool(info.depth));
+    out += ",\"thumbnails\":" + std::to_string(info.thumbnails);
+    out += ",\"exif\":" + std::string(json_bool(info.exif));
+    out += ",\"xmp\":" + std::string(json_bool(info.xmp));
+    return out + "}";
+}
+
+std::string csv_record(const ProbeInfo& info) {
+    std::string out = csv_field(info.path.string()) + "," + std::to_string(info.file_size);
+    if (!info.error.empty()) {
+        return out + ",,,,,,,,,,,," + csv_field(info.error) + "\n";
+    }
+    for (int v : {info.images, info.width, info.height, info.ispe_width, info.ispe_height,
+                  info.bit_depth, int(info.alpha), int(info.depth), info.thumbnails,
+                  int(info.exif), int(info.xmp)}) {
+        out += "," + std::to_string(v);
+    }
+    return out + ",\n";
+}
+
+}  // namespace
+
+bool parse_probe_format(const std::string& name, ProbeFormat& out) {
+    if (name == "json") {
+        out = ProbeFormat::Json;
+    } else if (name == "csv") {
+        out = ProbeFormat::Csv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool probe_heic(const fs::path& path, ProbeInfo& info) {
+    info.path = path;
+    std::error_code ec;
+    info.file_size = fs::file_size(path, ec);
+
+    // Reading from the file lets libheif seek past the image data; only the
+    // boxes it needs are read
+    std::unique_ptr<heif_context, void (*)(heif_context*)> ctx(heif_context_alloc(), heif_context_free);
+    heif_error err = heif_context_read_from_file(ctx.get(), path.c_str(), nullptr);
+    if (err.code != heif_error_Ok) {
+        info.error = err.message;
+        return false;
+    }
+
+    info.images = heif_context_get_number_of_top_level_images(ctx.get());
+
+    heif_image_handle* handle;
+    err = heif_context_get_primary_image_handle(ctx.get(), &handle);
+    if (err.code != heif_error_Ok) {
+        info.error = err.message;
+        return false;
+    }
+
+    info.width = heif_image_handle_get_width(handle);
+    info.height = heif_image_handle_get_height(handle);
+    info.ispe_width = heif_image_handle_get_ispe_width(handle);
+    info.ispe_height = heif_image_handle_get_ispe_height(handle);
+    info.bit_depth = heif_image_handle_get_luma_bits_per_pixel(handle);
+    info.alpha = heif_image_handle_has_alpha_channel(handle);
+    info.depth = heif_image_handle_has_depth_image(handle);
+    info.thumbnails = heif_image_handle_get_number_of_thumbnails(handle);
+    info.exif = heif_image_handle_get_number_of_metadata_blocks(handle, "Exif") > 0;
+    heif_item_id xmp_id;
+    info.xmp = find_xmp_block(handle, xmp_id);
+    heif_image_handle_release(handle);
+    return true;
+}
+
+ProbeWriter::ProbeWriter(int fd, ProbeFormat format) : fd_(fd), format_(format) {
+    if (format_ == ProbeFormat::Csv) {
+        buffer_ = "path,bytes,images,width,height,ispe_width,ispe_height,bit_depth,"
+                  "alpha,depth,thumbnails,exif,xmp,error\n";
+    } else {
+        buffer_ = "[";
+    }
+}
+
+void ProbeWriter::flush_locked() {
+    ok_ = ok_ && write_stream(fd_, reinterpret_cast<const uint8_t*>(buffer_.data()), buffer_.size());
+    buffer_.clear();
+}
+
+void ProbeWriter::add(const ProbeInfo& info) {
+    std::string record = format_ == ProbeFormat::Csv ? csv_record(info) : json_record(info);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (format_ == ProbeFormat::Json) {
+        buffer_ += records_ == 0 ? "\n" : ",\n";
+    }
+    buffer_ += record;
+    records_++;
+    if (buffer_.size() >= kFlushBytes) {
+        flush_locked();
+    }
+}
+
+bool ProbeWriter::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (format_ == ProbeFormat::Json) {
+        buffer_ += "\n]\n";
+    }
+    flush_locked();
+    return ok_;
+}
@@ -0,0 +1,69 @@
+/**
+ * Header-only inventory of HEIF files (--probe)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+namespace fs = std::filesystem;
+
+enum class ProbeFormat {
+    None,
+    Json,
+    Csv,
+};
+
+bool parse_probe_format(const std::string& name, ProbeFormat& out);
+
+// Quotes and escapes `s` as a JSON string
+std::string json_string(const std::string& s);
+
+struct ProbeInfo {
+    fs::path path;
+    uint64_t file_size = 0;
+    int images = 0;           // top-level images
+    int width = 0;            // primary image, after transformations
+    int height = 0;
+    int ispe_width = 0;       // coded size from the 'ispe' property
+    int ispe_height = 0;
+    int bit_depth = 0;
+    bool alpha = false;
+    bool depth = false;
+    int thumbnails = 0;
+    bool exif = false;
+    bool xmp = false;
+    std::string error;        // non-empty when the file could not be parsed
+};
+
+// Parses the container boxes of `path` without decoding any image data.
+// Returns false with `info.error` set for unreadable or invalid files.
+bool probe_heic(const fs::path& path, ProbeInfo& info);
+
+// Thread-safe, buffered writer of probe records. JSON output is an array with
+// one object per line; CSV output starts with a header row.
+class ProbeWriter {
+public:
+    ProbeWriter(int fd, ProbeFormat format);
+
+    ProbeWriter(const ProbeWriter&) = delete;
+    ProbeWriter& operator=(const ProbeWriter&) = delete;
+
+    void add(const ProbeInfo& info);
+
+    // Closes the JSON array and flushes the buffer
+    bool finish();
+
+private:
+    void flush_locked();
+
+    int fd_;
+    ProbeFormat format_;
+    bool ok_ = true;
+    size_t records_ = 0;
+    std::mutex mutex_;
+    std::string buffer_;
+};
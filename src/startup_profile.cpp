@@ -0,0 +1,67 @@
+/**
+ * Phase timings of process startup (--startup-profile)
+ */
+
+#include "startup_profile.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Mark {
+    const char* phase;
+    Clock::time_point time;
+};
+
+// Main thread only, and few enough that a fixed array avoids allocating
+constexpr size_t kMaxMarks = 16;
+Mark marks[kMaxMarks];
+size_t mark_count = 0;
+double cpu_before_main = 0.0;  // ms
+
+double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}  // namespace
+
+void startup_mark(const char* phase) {
+    if (mark_count == 0) {
+        // Dynamic linking, relocations and static initializers all run on
+        // the main thread before the first mark in main()
+        timespec ts;
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) {
+            cpu_before_main = ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+        }
+    }
+    if (mark_count < kMaxMarks) {
+        marks[mark_count++] = {phase, Clock::now()};
+    }
+}
+
+void print_startup_profile() {
+    if (mark_count == 0) {
+        return;
+    }
+    startup_mark("exit");
+
+    char line[96];
+    std::cerr << "⏱️  Startup profile" << std::endl;
+    snprintf(line, sizeof(line), "   %-14s %9.3f ms CPU (loader, static init)", "before main",
+             cpu_before_main);
+    std::cerr << line << std::endl;
+    for (size_t i = 1; i < mark_count; i++) {
+        snprintf(line, sizeof(line), "   %-14s %9.3f ms", marks[i].phase,
+                 elapsed_ms(marks[i - 1].time, marks[i].time));
+        std::cerr << line << std::endl;
+    }
+    snprintf(line, sizeof(line), "   %-14s %9.3f ms since main", "total",
+             elapsed_ms(marks[0].time, marks[mark_count - 1].time));
+    std::cerr << line << std::endl;
+}
@@ -0,0 +1,12 @@
+/**
+ * Phase timings of process startup (--startup-profile)
+ */
+
+#pragma once
+
+// Records that the main thread reached `phase`, which must be a string
+// literal. The first mark also samples the CPU time spent before main().
+void startup_mark(const char* phase);
+
+// Prints the recorded phases to stderr, ending with an "exit" mark
+void print_startup_profile();
@@ -0,0 +1,132 @@
+/**
+ * Tone mapping of high bit-depth HEIF images down to 8-bit
+ */
+
+#include "tonemap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "pixel_kernels.h"
+
+namespace {
+
+// SDR reference white and assumed mastering peak, in nits (ITU-R BT.2408)
+constexpr double kReferenceWhite = 203.0;
+constexpr double kPeakLuminance = 1000.0;
+
+double pq_to_linear(double e) {
+    const double m1 = 0.1593017578125;
+    const double m2 = 78.84375;
+    const double c1 = 0.8359375;
+    const double c2 = 18.8515625;
+    const double c3 = 18.6875;
+    double p = std::pow(e, 1.0 / m2);
+    double nits = 10000.0 * std::pow(std::max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+    return nits / kReferenceWhite;
+}
+
+double hlg_to_linear(double e) {
+    const double a = 0.17883277;
+    const double b = 0.28466892;
+    const double c = 0.55991073;
+    double scene = e <= 0.5 ? e * e / 3.0 : (std::exp((e - c) / a) + b) / 12.0;
+    // Per-channel approximation of the BT.2100 OOTF for a 1000 nit display
+    return kPeakLuminance * std::pow(scene, 1.2) / kReferenceWhite;
+}
+
+double linear_to_srgb(double l) {
+    return l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+}
+
+// Extended Reinhard: maps `white` to 1.0 and is the identity for white == 1
+double reinhard(double l, double white) {
+    return l * (1.0 + l / (white * white)) / (1.0 + l);
+}
+
+double map_sample(double e, ToneMap op) {
+    const double peak = kPeakLuminance / kReferenceWhite;
+    switch (op) {
+        case ToneMap::PQ:
+            return linear_to_srgb(std::min(reinhard(pq_to_linear(e), peak), 1.0));
+        case ToneMap::HLG:
+            return linear_to_srgb(std::min(reinhard(hlg_to_linear(e), peak), 1.0));
+        // SDR content has nothing above white to compress, so reinhard leaves
+        // it alone; on PQ and HLG content resolve_tone_map picks their curves
+        case ToneMap::Reinhard:
+        case ToneMap::Clip:
+        case ToneMap::Auto:
+            break;
+    }
+    return e;
+}
+
+// Builds a table from code value to 8.8 fixed point output in [0, 255 * 256]
+std::vector<uint16_t> build_lut(int bit_depth, ToneMap op) {
+    int size = 1 << bit_depth;
+    double max_code = size - 1;
+    std::vector<uint16_t> lut(size);
+    for (int v = 0; v < size; v++) {
+        double out = std::clamp(map_sample(v / max_code, op), 0.0, 1.0);
+        lut[v] = static_cast<uint16_t>(std::lround(out * 255.0 * 256.0));
+    }
+    return lut;
+}
+
+}  // namespace
+
+bool parse_tone_map(const std::string& name, ToneMap& out) {
+    if (name == "auto") {
+        out = ToneMap::Auto;
+    } else if (name == "clip") {
+        out = ToneMap::Clip;
+    } else if (name == "reinhard") {
+        out = ToneMap::Reinhard;
+    } else if (name == "pq") {
+        out = ToneMap::PQ;
+    } else if (name == "hlg") {
+        out = ToneMap::HLG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* tone_map_name(ToneMap op) {
+    switch (op) {
+        case ToneMap::Auto: return "auto";
+        case ToneMap::Clip: return "clip";
+        case ToneMap::Reinhard: return "reinhard";
+        case ToneMap::PQ: return "pq";
+        case ToneMap::HLG: return "hlg";
+    }
+    return "unknown";
+}
+
+ToneMap resolve_tone_map(ToneMap requested, const heif_image_handle* handle) {
+    if (requested != ToneMap::Auto && requested != ToneMap::Reinhard) {
+        return requested;
+    }
+
+    // Both fall back to a plain rescale for SDR content
+    ToneMap resolved = ToneMap::Clip;
+    heif_color_profile_nclx* nclx = nullptr;
+    heif_error err = heif_image_handle_get_nclx_color_profile(handle, &nclx);
+    if (err.code == heif_error_Ok && nclx) {
+        if (nclx->transfer_characteristics == heif_transfer_characteristic_ITU_R_BT_2100_0_PQ) {
+            resolved = ToneMap::PQ;
+        } else if (nclx->transfer_characteristics == heif_transfer_characteristic_ITU_R_BT_2100_0_HLG) {
+            resolved = ToneMap::HLG;
+        }
+        heif_nclx_color_profile_free(nclx);
+    }
+    return resolved;
+}
+
+void tone_map_to_8bit(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                      int width, int height, int channels, int bit_depth, ToneMap op) {
+    std::vector<uint16_t> lut = build_lut(bit_depth, op);
+    const PixelKernels& kernels = select_kernels({channels, bit_depth});
+    kernels.tone_map(src, src_stride, dst, dst_stride, width, height, lut.data());
+}
@@ -0,0 +1,33 @@
+/**
+ * Tone mapping of high bit-depth HEIF images down to 8-bit
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <libheif/heif.h>
+
+enum class ToneMap {
+    Auto,      // pick from the image's transfer characteristics
+    Clip,      // rescale code values, no transfer curve change
+    Reinhard,  // roll off PQ/HLG highlights; SDR content is only rescaled
+    PQ,        // SMPTE ST 2084 (PQ) → SDR
+    HLG,       // ARIB STD-B67 (HLG) → SDR
+};
+
+bool parse_tone_map(const std::string& name, ToneMap& out);
+const char* tone_map_name(ToneMap op);
+
+// Resolves ToneMap::Auto and ToneMap::Reinhard using the NCLX profile of the
+// image handle: PQ and HLG content gets its own transfer curve, which rolls
+// off highlights with Reinhard, and anything else gets Clip
+ToneMap resolve_tone_map(ToneMap requested, const heif_image_handle* handle);
+
+// Converts interleaved little-endian 16-bit samples (RRGGBB or RRGGBBAA) holding
+// `bit_depth` significant bits into 8-bit RGB(A). Colour channels are mapped
+// through a per-image lookup table and ordered-dithered in the same pass;
+// alpha is rescaled without dithering.
+void tone_map_to_8bit(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                      int width, int height, int channels, int bit_depth, ToneMap op);
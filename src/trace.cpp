@@ -0,0 +1,213 @@
+/**
+ * Per-file pipeline timelines in Chrome trace-event format (--trace)
+ */
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "io_backend.h"
+#include "metrics.h"
+#include "probe.h"
+
+namespace {
+
+// Events kept per thread; older ones are overwritten once a thread has
+// recorded this many
+constexpr size_t kRingEvents = 64 * 1024;
+
+struct TraceEvent {
+    int64_t start;  // ns since tracing started
+    int64_t end;
+    TraceStage stage;
+    TraceLabel file;
+};
+
+// Written only by its own thread, read once all threads are done
+struct ThreadTrace {
+    int tid = 0;
+    std::vector<TraceEvent> events;  // grows up to kRingEvents, then wraps
+    size_t next = 0;                 // oldest event once wrapped
+    uint64_t dropped = 0;
+
+    void record(const TraceEvent& event) {
+        if (events.size() < kRingEvents) {
+            events.push_back(event);
+            return;
+        }
+        events[next] = event;
+        next = (next + 1) % kRingEvents;
+        dropped++;
+    }
+};
+
+bool enabled = false;
+int trace_fd = -1;
+std::string trace_path;
+std::chrono::steady_clock::time_point trace_start;
+
+// Buffers outlive their threads, e.g. the per-frame decoders of animations
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadTrace>> registry;
+
+thread_local ThreadTrace* thread_trace = nullptr;
+thread_local TraceLabel thread_label = {};
+
+ThreadTrace& this_thread_trace() {
+    if (!thread_trace) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadTrace>());
+        registry.back()->tid = static_cast<int>(registry.size());
+        thread_trace = registry.back().get();
+    }
+    return *thread_trace;
+}
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - trace_start).count();
+}
+
+void append_event(std::string& out, int tid, const TraceEvent& event) {
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             ",\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+             "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":",
+             trace_stage_name(event.stage), tid, event.start / 1e3, (event.end - event.start) / 1e3);
+    out += buf;
+    out += json_string(event.file.data());
+    out += "}}";
+}
+
+void write_trace() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                      "\"args\":{\"name\":\"heic2webp\"}}";
+    size_t events = 0;
+    uint64_t dropped = 0;
+    bool ok = true;
+
+    for (const auto& thread : registry) {
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+               std::to_string(thread->tid) + ",\"args\":{\"name\":\"" +
+               (thread->tid == 1 ? std::string("main") : "thread " + std::to_string(thread->tid)) +
+               "\"}}";
+        // Oldest first once the ring has wrapped
+        for (size_t i = 0; i < thread->events.size(); i++) {
+            append_event(out, thread->tid, thread->events[(thread->next + i) % thread->events.size()]);
+            if (out.size() >= 1024 * 1024) {
+                ok = ok && write_stream(trace_fd, reinterpret_cast<const uint8_t*>(out.data()), out.size());
+                out.clear();
+            }
+        }
+        events += thread->events.size();
+        dropped += thread->dropped;
+    }
+    out += "\n]}\n";
+    ok = ok && write_stream(trace_fd, reinterpret_cast<const uint8_t*>(out.data()), out.size());
+    ok = ::close(trace_fd) == 0 && ok;
+
+    if (!ok) {
+        std::cerr << "❌ Failed to write trace: " << trace_path << std::endl;
+        return;
+    }
+    std::cout << "🧭 Trace: " << events << " span(s) in " << trace_path;
+    if (dropped > 0) {
+        std::cout << " (" << dropped << " oldest dropped)";
+    }
+    std::cout << std::endl;
+}
+
+}  // namespace
+
+const char* trace_stage_name(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::Read: return "read";
+        case TraceStage::Parse: return "parse";
+        case TraceStage::Decode: return "decode";
+        case TraceStage::Convert: return "convert";
+        case TraceStage::Encode: return "encode";
+        case TraceStage::Write: return "write";
+    }
+    return "unknown";
+}
+
+bool start_tracing(const std::string& path) {
+    trace_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        std::cerr << "❌ Cannot create trace file: " << path << std::endl;
+        return false;
+    }
+    trace_path = path;
+    trace_start = std::chrono::steady_clock::now();
+    this_thread_trace();  // the main thread is tid 1
+    enabled = true;
+    std::atexit(write_trace);
+    return true;
+}
+
+bool tracing() {
+    return enabled;
+}
+
+TraceFile::TraceFile(const fs::path& file) {
+    if (!enabled) return;
+    previous_ = thread_label;
+    active_ = true;
+    std::string name = file.filename().string();
+    size_t n = std::min(name.size(), thread_label.size() - 1);
+    // Don't split a UTF-8 sequence, so the label stays valid JSON
+    while (n < name.size() && n > 0 && (static_cast<unsigned char>(name[n]) & 0xc0) == 0x80) {
+        n--;
+    }
+    memcpy(thread_label.data(), name.data(), n);
+    thread_label[n] = '\0';
+}
+
+TraceFile::TraceFile(const TraceLabel& label) {
+    if (!enabled) return;
+    previous_ = thread_label;
+    active_ = true;
+    thread_label = label;
+}
+
+TraceFile::~TraceFile() {
+    if (active_) {
+        thread_label = previous_;
+    }
+}
+
+TraceLabel TraceFile::current() {
+    return thread_label;
+}
+
+TraceSpan::TraceSpan(TraceStage stage) : stage_(stage) {
+    if (enabled || metrics_enabled()) {
+        start_ = now_ns();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (start_ < 0) {
+        return;
+    }
+    int64_t end = now_ns();
+    if (enabled) {
+        this_thread_trace().record({start_, end, stage_, thread_label});
+    }
+    if (metrics_enabled()) {
+        observe_stage(stage_, end - start_);
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * Per-file pipeline timelines in Chrome trace-event format (--trace)
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+enum class TraceStage : uint8_t {
+    Read,
+    Parse,
+    Decode,
+    Convert,  // tone mapping and RGB → YUV
+    Encode,
+    Write,
+};
+
+const char* trace_stage_name(TraceStage stage);
+
+// File name recorded with each span, truncated to fit
+using TraceLabel = std::array<char, 48>;
+
+// Creates `path` and enables tracing. The trace is written when the process
+// exits; call before any worker thread starts.
+bool start_tracing(const std::string& path);
+
+bool tracing();
+
+// Labels the calling thread's spans with a file until the scope ends
+class TraceFile {
+public:
+    explicit TraceFile(const fs::path& file);
+    explicit TraceFile(const TraceLabel& label);  // e.g. carried to a helper thread
+    ~TraceFile();
+
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    // The calling thread's current label
+    static TraceLabel current();
+
+private:
+    TraceLabel previous_;
+    bool active_ = false;
+};
+
+// Records one stage on the calling thread from construction to destruction,
+// as a trace span and in the stage latency metrics. Does nothing unless one
+// of them is enabled.
+class TraceSpan {
+public:
+    explicit TraceSpan(TraceStage stage);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceStage stage_;
+    int64_t start_ = -1;
+};
@@ -0,0 +1,149 @@
+/**
+ * Fixed-size thread pool for batch conversion
+ */
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "metrics.h"
+
+namespace {
+
+// std heaps keep the largest element on top, so "less" means "runs later"
+struct RunsLater {
+    template <typename Entry>
+    bool operator()(const Entry& a, const Entry& b) const {
+        if (a.continuation != b.continuation) return b.continuation;
+        if (a.deadline != b.deadline) return a.deadline > b.deadline;
+        return a.sequence > b.sequence;
+    }
+};
+
+}  // namespace
+
+bool parse_priority(const std::string& name, Priority& out) {
+    if (name == "interactive") {
+        out = Priority::Interactive;
+    } else if (name == "bulk") {
+        out = Priority::Bulk;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+WorkerPool::WorkerPool(size_t threads, std::function<void()> thread_init) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threads);
+    limit_ = threads;
+    adjust_workers(static_cast<int64_t>(threads));
+    for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back([this, thread_init] { run(thread_init); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    adjust_workers(-static_cast<int64_t>(workers_.size()));
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+    submit(std::move(task), TaskOptions());
+}
+
+void WorkerPool::submit(std::function<void()> task, TaskOptions options) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& queue = queues_[static_cast<int>(options.priority)];
+        queue.push_back({options.continuation, options.deadline, sequence_++, std::move(task),
+                         std::move(options.expired)});
+        std::push_heap(queue.begin(), queue.end(), RunsLater());
+    }
+    adjust_queue_depth(1);
+    work_cv_.notify_one();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return idle(); });
+}
+
+void WorkerPool::hold() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_++;
+}
+
+void WorkerPool::release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_--;
+    if (idle()) {
+        idle_cv_.notify_all();
+    }
+}
+
+void WorkerPool::set_concurrency(size_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = std::clamp<size_t>(limit, 1, workers_.size());
+    }
+    work_cv_.notify_all();
+}
+
+size_t WorkerPool::queued(Priority priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queues_[static_cast<int>(priority)].size();
+}
+
+void WorkerPool::run(const std::function<void()>& thread_init) {
+    if (thread_init) {
+        thread_init();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        work_cv_.wait(lock, [this] { return stopping_ || (!empty() && active_ < limit_); });
+        if (empty()) {
+            return;  // stopping and drained
+        }
+
+        auto& queue = queues_[0].empty() ? queues_[1] : queues_[0];
+        std::pop_heap(queue.begin(), queue.end(), RunsLater());
+        Entry entry = std::move(queue.back());
+        queue.pop_back();
+        active_++;
+
+        lock.unlock();
+        adjust_queue_depth(-1);
+
+        // Work past its deadline is dropped before it takes a worker's time
+        std::function<void()> task = std::move(entry.task);
+        if (entry.deadline != kNoDeadline && std::chrono::steady_clock::now() > entry.deadline) {
+            task = std::move(entry.expired);
+        }
+        if (task && metrics_enabled()) {
+            auto start = std::chrono::steady_clock::now();
+            task();
+            count_busy_time(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        } else if (task) {
+            task();
+        }
+        lock.lock();
+
+        active_--;
+        if (idle()) {
+            idle_cv_.notify_all();
+        }
+    }
+}
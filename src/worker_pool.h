@@ -0,0 +1,97 @@
+/**
+ * Fixed-size thread pool for batch conversion
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Interactive tasks always run before queued bulk tasks. A running task is
+// never interrupted, so bulk work yields at file boundaries.
+enum class Priority {
+    Interactive,
+    Bulk,
+};
+
+bool parse_priority(const std::string& name, Priority& out);
+
+using Deadline = std::chrono::steady_clock::time_point;
+constexpr Deadline kNoDeadline = Deadline::max();
+
+struct TaskOptions {
+    Priority priority = Priority::Bulk;
+    Deadline deadline = kNoDeadline;
+    std::function<void()> expired;  // runs instead of the task once the deadline has passed
+
+    // Carries on with a file another task started, e.g. once its input has
+    // been read: runs before the tasks of its class that haven't started
+    bool continuation = false;
+};
+
+class WorkerPool {
+public:
+    // `threads` == 0 uses one worker per hardware thread. `thread_init` runs on
+    // each worker before it takes its first task.
+    explicit WorkerPool(size_t threads, std::function<void()> thread_init = {});
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queues a bulk task without a deadline; tasks may submit further tasks
+    // but must not wait on them
+    void submit(std::function<void()> task);
+
+    // Within a priority class, tasks run earliest deadline first; tasks
+    // without one run in submission order after those with one
+    void submit(std::function<void()> task, TaskOptions options);
+
+    // Blocks until the queue is empty, no task is running and nothing is held
+    void wait();
+
+    // Keeps wait() from returning until the matching release(), for work that
+    // left the pool and will submit a task later, e.g. a read in flight
+    void hold();
+    void release();
+
+    size_t size() const { return workers_.size(); }
+
+    // Caps how many tasks run at once, between 1 and size(); the other
+    // workers stay parked. Running tasks are not interrupted.
+    void set_concurrency(size_t limit);
+
+    // Tasks of `priority` waiting for a worker
+    size_t queued(Priority priority);
+
+private:
+    struct Entry {
+        bool continuation;
+        Deadline deadline;
+        uint64_t sequence;
+        std::function<void()> task;
+        std::function<void()> expired;
+    };
+
+    void run(const std::function<void()>& thread_init);
+    bool empty() const { return queues_[0].empty() && queues_[1].empty(); }
+    bool idle() const { return empty() && active_ == 0 && held_ == 0; }
+
+    std::vector<std::thread> workers_;
+    std::vector<Entry> queues_[2];  // binary heaps, indexed by Priority
+    uint64_t sequence_ = 0;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    size_t active_ = 0;
+    size_t held_ = 0;
+    size_t limit_ = 0;
+    bool stopping_ = false;
+};
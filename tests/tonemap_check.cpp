@@ -0,0 +1,72 @@
+/**
+ * Checks the tone mapping tables of 10-bit content
+ *
+ * Every code value is mapped once per operator. SDR content needs no tone
+ * mapping, so reinhard must match clip's plain rescale exactly. The PQ and
+ * HLG curves must keep black black, reach white at the top code value and
+ * never get darker as the code value rises.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "tonemap.h"
+
+namespace {
+
+constexpr int kBitDepth = 10;
+constexpr int kCodes = 1 << kBitDepth;
+
+// One pixel per code value, grey, so each output byte is that code's entry
+std::vector<uint8_t> map_codes(ToneMap op) {
+    std::vector<uint8_t> src(kCodes * 6);
+    for (int v = 0; v < kCodes; v++) {
+        for (int c = 0; c < 3; c++) {
+            src[v * 6 + c * 2] = static_cast<uint8_t>(v & 0xff);
+            src[v * 6 + c * 2 + 1] = static_cast<uint8_t>(v >> 8);
+        }
+    }
+    std::vector<uint8_t> rgb(kCodes * 3);
+    tone_map_to_8bit(src.data(), kCodes * 6, rgb.data(), kCodes * 3, kCodes, 1, 3, kBitDepth, op);
+
+    std::vector<uint8_t> out(kCodes);
+    for (int v = 0; v < kCodes; v++) {
+        out[v] = rgb[v * 3];
+    }
+    return out;
+}
+
+// Dithering moves any entry by at most one step
+bool rising(const std::vector<uint8_t>& out) {
+    for (int v = 1; v < kCodes; v++) {
+        if (out[v] + 1 < out[v - 1]) return false;
+    }
+    return true;
+}
+
+bool expect(bool ok, const char* what) {
+    std::cout << (ok ? "✅ " : "❌ ") << what << std::endl;
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<uint8_t> clip = map_codes(ToneMap::Clip);
+    std::vector<uint8_t> reinhard = map_codes(ToneMap::Reinhard);
+    std::vector<uint8_t> pq = map_codes(ToneMap::PQ);
+    std::vector<uint8_t> hlg = map_codes(ToneMap::HLG);
+
+    int failures = 0;
+    failures += !expect(clip[0] == 0 && clip[kCodes - 1] == 255, "clip keeps black and white");
+    failures += !expect(reinhard == clip, "reinhard leaves SDR content as clip does");
+    failures += !expect(pq[0] == 0 && pq[kCodes - 1] == 255, "pq keeps black and white");
+    failures += !expect(hlg[0] == 0 && hlg[kCodes - 1] == 255, "hlg keeps black and white");
+    failures += !expect(rising(pq) && rising(hlg), "pq and hlg never darken as the code rises");
+    if (failures > 0) {
+        std::cerr << "❌ " << failures << " tone mapping check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
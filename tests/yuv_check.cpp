@@ -0,0 +1,177 @@
+/**
+ * Checks import_frame's YUV 4:2:0 planes against libwebp's own import
+ *
+ * Opaque frames go through our rgb_to_yuv420 kernel and must match
+ * WebPPictureImportRGB byte for byte; alpha frames must match
+ * WebPPictureImportRGBA, alpha plane included. With --bench, times both
+ * imports on a 12 MP frame instead.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <webp/encode.h>
+
+#include "encode.h"
+
+namespace {
+
+// Deterministic noise, so a failure reproduces
+uint32_t next_random(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Noise in the top half exercises the rounding of every coefficient; the
+// gradient in the bottom half covers smooth chroma, as in real photos
+std::vector<uint8_t> make_pixels(int width, int height, int channels, uint32_t seed) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * channels);
+    uint32_t state = seed;
+    for (int row = 0; row < height; row++) {
+        uint8_t* p = pixels.data() + static_cast<size_t>(row) * width * channels;
+        for (int col = 0; col < width; col++, p += channels) {
+            for (int c = 0; c < channels; c++) {
+                p[c] = row < height / 2
+                    ? static_cast<uint8_t>(next_random(state))
+                    : static_cast<uint8_t>((col * 255 / std::max(width - 1, 1) + c * 85 + row) & 0xff);
+            }
+        }
+    }
+    return pixels;
+}
+
+bool same_plane(const char* name, const uint8_t* a, int a_stride, const uint8_t* b, int b_stride,
+                int width, int height) {
+    for (int row = 0; row < height; row++) {
+        const uint8_t* ra = a + static_cast<size_t>(row) * a_stride;
+        const uint8_t* rb = b + static_cast<size_t>(row) * b_stride;
+        if (std::memcmp(ra, rb, width) == 0) {
+            continue;
+        }
+        int col = static_cast<int>(std::mismatch(ra, ra + width, rb).first - ra);
+        std::cerr << "  " << name << " differs at (" << col << ", " << row << "): "
+                  << int(ra[col]) << " vs libwebp " << int(rb[col]) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+DecodedFrame make_frame(const std::vector<uint8_t>& pixels, int width, int height, bool alpha) {
+    DecodedFrame frame;
+    frame.pixels = pixels.data();
+    frame.stride = width * (alpha ? 4 : 3);
+    frame.width = width;
+    frame.height = height;
+    frame.has_alpha = alpha;
+    return frame;
+}
+
+bool import_reference(const DecodedFrame& frame, WebPPicture& pic) {
+    pic.width = frame.width;
+    pic.height = frame.height;
+    pic.use_argb = 0;
+    return frame.has_alpha ? WebPPictureImportRGBA(&pic, frame.pixels, frame.stride)
+                           : WebPPictureImportRGB(&pic, frame.pixels, frame.stride);
+}
+
+bool check(int width, int height, bool alpha) {
+    std::vector<uint8_t> pixels = make_pixels(width, height, alpha ? 4 : 3, width * 7919u + height);
+    DecodedFrame frame = make_frame(pixels, width, height, alpha);
+
+    WebPPicture ours, reference;
+    WebPPictureInit(&ours);
+    WebPPictureInit(&reference);
+    bool ok = import_frame(frame, false, ours) && import_reference(frame, reference);
+    if (!ok) {
+        std::cerr << "  import failed" << std::endl;
+    }
+
+    int uv_width = (width + 1) / 2;
+    int uv_height = (height + 1) / 2;
+    ok = ok && same_plane("Y", ours.y, ours.y_stride, reference.y, reference.y_stride, width, height);
+    ok = ok && same_plane("U", ours.u, ours.uv_stride, reference.u, reference.uv_stride, uv_width, uv_height);
+    ok = ok && same_plane("V", ours.v, ours.uv_stride, reference.v, reference.uv_stride, uv_width, uv_height);
+    // libwebp drops the alpha plane when every pixel turns out to be opaque
+    if (ok && (ours.a || reference.a)) {
+        if (!ours.a || !reference.a) {
+            std::cerr << "  alpha plane " << (ours.a ? "added" : "missing") << std::endl;
+            ok = false;
+        } else {
+            ok = same_plane("A", ours.a, ours.a_stride, reference.a, reference.a_stride, width, height);
+        }
+    }
+
+    WebPPictureFree(&ours);
+    WebPPictureFree(&reference);
+    std::cout << (ok ? "✅ " : "❌ ") << width << "x" << height << (alpha ? " RGBA" : " RGB")
+              << std::endl;
+    return ok;
+}
+
+// Best of `runs`, in milliseconds
+template <typename Import>
+double time_import(const DecodedFrame& frame, int runs, Import import) {
+    double best = 0;
+    for (int i = 0; i < runs; i++) {
+        WebPPicture pic;
+        WebPPictureInit(&pic);
+        auto start = std::chrono::steady_clock::now();
+        import(frame, pic);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        WebPPictureFree(&pic);
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+int bench(int runs) {
+    const int width = 4032;
+    const int height = 3024;
+    std::vector<uint8_t> pixels = make_pixels(width, height, 3, 1);
+    DecodedFrame frame = make_frame(pixels, width, height, false);
+
+    double ours = time_import(frame, runs, [](const DecodedFrame& f, WebPPicture& pic) {
+        import_frame(f, false, pic);
+    });
+    double reference = time_import(frame, runs, [](const DecodedFrame& f, WebPPicture& pic) {
+        import_reference(f, pic);
+    });
+
+    std::cout << width << "x" << height << " RGB to YUV 4:2:0, best of " << runs << " runs\n"
+              << "  rgb_to_yuv420:        " << ours << " ms\n"
+              << "  WebPPictureImportRGB: " << reference << " ms (" << reference / ours << "x)"
+              << std::endl;
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        return bench(argc > 2 ? std::max(std::atoi(argv[2]), 1) : 10);
+    }
+
+    // Odd sizes take the kernel's scalar edge paths for the last row and column
+    const int sizes[][2] = {{1, 1}, {2, 2}, {3, 1}, {1, 5}, {17, 9}, {31, 32}, {63, 33},
+                            {64, 64}, {641, 479}, {1023, 1}};
+    int failures = 0;
+    for (const auto& size : sizes) {
+        for (bool alpha : {false, true}) {
+            failures += !check(size[0], size[1], alpha);
+        }
+    }
+    if (failures > 0) {
+        std::cerr << "❌ " << failures << " frame(s) differ from libwebp" << std::endl;
+        return 1;
+    }
+    return 0;
+}